@@ -0,0 +1,95 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+#include "alternative.h"
+#include "cpu.h"
+#include "print.h"
+#include "util.h"
+
+#define NOP_MAX_SIZE        8
+
+#define OPCODE_CALL_REL32   0xe8
+#define OPCODE_JMP_REL32    0xe9
+
+/* the recommended multi-byte NOPs (0f 1f /0), n bytes long at p6_nops[n] */
+static const uint8_t p6_nops_bytes[] = {
+	0x90,
+	0x66, 0x90,
+	0x0f, 0x1f, 0x00,
+	0x0f, 0x1f, 0x40, 0x00,
+	0x0f, 0x1f, 0x44, 0x00, 0x00,
+	0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00,
+	0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00,
+	0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static void add_nops(uint8_t *dest, uint32_t len)
+{
+	uint32_t n;
+
+	while (len) {
+		n = MIN(len, NOP_MAX_SIZE);
+		/* the n byte NOP starts after the 1 + 2 + ... + (n - 1) before it */
+		memcpy(dest, &p6_nops_bytes[n * (n - 1) / 2], n);
+		dest += n;
+		len -= n;
+	}
+}
+
+boolean_t apply_alternatives(uint64_t start, uint64_t size,
+		uint64_t image_base, uint64_t image_size, uint32_t *applied)
+{
+	alt_instr_t *alt = (alt_instr_t *)start;
+	alt_instr_t *end = (alt_instr_t *)(start + size - size % sizeof(alt_instr_t));
+	uint8_t *instr;
+	uint8_t *repl;
+	int32_t disp;
+
+	*applied = 0;
+
+	for (; alt < end; ++alt) {
+		instr = (uint8_t *)&alt->instr_offset + alt->instr_offset;
+		repl = (uint8_t *)&alt->repl_offset + alt->repl_offset;
+
+		if ((alt->replacementlen > alt->instrlen) ||
+			((uint64_t)instr < image_base) ||
+			((uint64_t)instr + alt->instrlen > image_base + image_size) ||
+			((uint64_t)repl < image_base) ||
+			((uint64_t)repl + alt->replacementlen > image_base + image_size)) {
+			printf("trusty loader: invalid alternative at 0x%lx\n",
+					(uint64_t)alt);
+			return FALSE;
+		}
+
+		if (!cpu_has_feature(alt->cpuid))
+			continue;
+
+		memcpy(instr, repl, alt->replacementlen);
+
+		/* a leading rel32 call/jmp has to keep its target after moving */
+		if ((alt->replacementlen >= 5) && ((OPCODE_CALL_REL32 == repl[0]) ||
+					(OPCODE_JMP_REL32 == repl[0]))) {
+			memcpy(&disp, repl + 1, sizeof(disp));
+			disp += (int32_t)(repl - instr);
+			memcpy(instr + 1, &disp, sizeof(disp));
+		}
+
+		add_nops(instr + alt->replacementlen,
+				alt->instrlen - alt->replacementlen);
+		++*applied;
+	}
+
+	return TRUE;
+}
@@ -0,0 +1,48 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef _ALTERNATIVE_H_
+#define _ALTERNATIVE_H_
+
+#include "trusty_loader_base.h"
+
+/* name of the trusty section holding the alt_instr_t table */
+#define ALT_INSTR_SECTION       ".altinstructions"
+
+/*
+ * One entry of the alternatives table, same layout as Linux's struct
+ * alt_instr. Both offsets are relative to the field that holds them, so
+ * the table needs no relocation. cpuid is a cpu.h X86_FEATURE_* id: when
+ * the CPU has it, the instrlen bytes at the original instruction are
+ * replaced with the replacementlen bytes at the replacement and the rest
+ * is filled with NOPs.
+ */
+typedef struct {
+	int32_t		instr_offset;
+	int32_t		repl_offset;
+	uint16_t	cpuid;
+	uint8_t		instrlen;
+	uint8_t		replacementlen;
+} alt_instr_t;
+
+/* patch the image loaded at [image_base, image_base + image_size) through
+ * the table at [start, start + size). fails on entries pointing outside the
+ * image, *applied is the number of entries the CPU qualified for.
+ */
+boolean_t apply_alternatives(uint64_t start, uint64_t size,
+		uint64_t image_base, uint64_t image_size, uint32_t *applied);
+
+#endif
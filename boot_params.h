@@ -0,0 +1,160 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef _BOOT_PARAMS_H_
+#define _BOOT_PARAMS_H_
+
+#include "trusty_loader_base.h"
+#include "elf_ld.h"
+
+/* what vSBL hands the loader and the loader hands ACRN and Linux */
+
+#define MULTIBOOT_HEADER_SIZE         32
+/* trusty_pkg_offset, then trusty_image_digest in trusty_loader_entry.S */
+#define TRUSTY_PKG_OFFSET_OFFSET      MULTIBOOT_HEADER_SIZE
+#define TRUSTY_IMAGE_DIGEST_OFFSET    (MULTIBOOT_HEADER_SIZE + 4)
+
+/* first word of the cmdline of the multiboot module holding lk */
+#define TRUSTY_MODULE_NAME            "trusty"
+
+#define TRUSTY_RUNTIME_BASE         0x7FC0000000
+#define TRUSTY_RSVD_SIZE            0x1000
+#define TRUSTY_64BIT_ENTRY_OFFSET   0x400
+
+/*
+ * Trusty boot params, used for HC_INITIALIZE_TRUSTY.
+ */
+
+typedef struct {
+    uint32_t size_of_struct;    /* sizeof this structure */
+    uint32_t version;           /* version of this structure */
+    uint32_t base_addr;         /* trusty runtime memory base address */
+    uint32_t entry_point;       /* trusty entry point */
+    uint32_t mem_size;          /* trusty runtime memory size */
+    uint32_t padding;           /* padding */
+    uint32_t base_addr_high;    /* trusty runtime memory base address (high 32bit) */
+    uint32_t entry_point_high;  /* trusty entry point (high 32bit) */
+    uint8_t  rpmb_key[64];      /* rpmb key */
+    /* version 3, with TRUSTY_BOOT_PARAMS_V3: the loaded segments, for
+     * trusty's and the EPT's page tables. ELF_SEG_LARGE_PAGE marks the
+     * ones 2M pages can map */
+    uint64_t load_base;         /* where the image starts, base_addr + pad */
+    uint32_t segment_count;
+    uint32_t padding2;          /* padding */
+    elf_segment_info_t segments[ELF_MAX_LOAD_SEGMENTS];
+} trusty_boot_param_t;
+
+/* a hypervisor that takes versions up to 2, as upstream ACRN does, refuses
+ * to start trusty with version 3. version 2 ends at load_base */
+#ifdef TRUSTY_BOOT_PARAMS_V3
+#define TRUSTY_BOOT_PARAM_VERSION   3
+#define TRUSTY_BOOT_PARAM_SIZE      sizeof(trusty_boot_param_t)
+#else
+#define TRUSTY_BOOT_PARAM_VERSION   2
+#define TRUSTY_BOOT_PARAM_SIZE      ((uint64_t)&((trusty_boot_param_t *)0)->load_base)
+#endif
+
+/* trusty memory from TRUSTY_RUNTIME_BASE, mem_size in the boot params.
+ * the image, its alignment pad included, must end within it */
+#define TRUSTY_MEM_SIZE             TRUSTY_RUNTIME_TOTAL_SIZE
+
+/* arguments parsed from cmdline */
+typedef struct {
+	uint32_t size_of_struct;
+    uint32_t version;
+    uint64_t seedlist_info_addr;
+    uint64_t platform_info_addr;
+    uint64_t vmm_boot_param_addr;
+    /* valid if size_of_struct covers them: memory vSBL hands over already
+     * zero-filled, the loader does not clear trusty bss pages inside it */
+    uint64_t zeroed_mem_base;
+    uint64_t zeroed_mem_size;
+} image_boot_param_t;
+
+/* Linux boot cpu sate */
+typedef struct {
+  uint32_t eip;
+  uint32_t eax;
+  uint32_t ebx;
+  uint32_t esi;
+  uint32_t edi;
+  uint32_t ecx;
+} cpu_boot_state_t;
+
+/* Linux boot params, used for linux launch */
+typedef struct {
+  uint32_t size_of_struct;
+  uint32_t version;
+  cpu_boot_state_t cpu_state;
+} linux_boot_param_t;
+
+
+/* a.out kernel image */
+typedef struct {
+	uint32_t tabsize;
+	uint32_t strsize;
+	uint32_t addr;
+	uint32_t reserved;
+} aout_t;
+
+/* elf kernel */
+typedef struct {
+	uint32_t num;
+	uint32_t size;
+	uint32_t addr;
+	uint32_t shndx;
+} elf_t;
+
+/* only used partial of the standard multiboot_info_t */
+typedef struct {
+	uint32_t flags;
+
+	/* valid if flags[0] (MBI_MEMLIMITS) set */
+	uint32_t mem_lower;
+	uint32_t mem_upper;
+
+	/* valid if flags[1] set */
+	uint32_t boot_device;
+
+	/* valid if flags[2] (MBI_CMDLINE) set */
+	uint32_t cmdline;
+
+	/* valid if flags[3] (MBI_MODS) set */
+	uint32_t mods_count;
+	uint32_t mods_addr;
+
+	/* valid if flags[4] or flags[5] set */
+	union {
+		aout_t aout_image;
+		elf_t elf_image;
+	} syms;
+
+	/* valid if flags[6] (MBI_MEMMAP) set */
+	uint32_t mmap_length;
+	uint32_t mmap_addr;
+} multiboot_info_t;
+
+/* mods_addr points to mods_count of these */
+typedef struct {
+	uint32_t mod_start;
+	uint32_t mod_end;           /* first byte past the module */
+	uint32_t cmdline;           /* "name args", may be 0 */
+	uint32_t reserved;
+} multiboot_module_t;
+
+void trusty_loader_main(uint64_t *multiboot_info, uint64_t trusty_loader_base);
+
+#endif
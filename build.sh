@@ -16,7 +16,7 @@
 # limitations under the License.
 ################################################################################
 
-# To stich trusty image, LKBIN_DIR should be defined
+# To build the trusty image, LKBIN_DIR should be defined
 #export LKBIN_DIR=
 export COMPILE_TOOLCHAIN=
 export BUILD_DIR=$PWD/out/
@@ -27,22 +27,42 @@ make
 
 cp ${LKBIN_DIR}lk.elf ${BUILD_DIR}
 
-# File sizes in 512-byte blocks
+# Set TRUSTY_RELR=1 to pack the relative relocations as DT_RELR
+if [ -n "${TRUSTY_RELR}" ]; then
+    python3 tools/relrpack.py ${BUILD_DIR}lk.elf ${BUILD_DIR}lk.elf
+fi
 
-s=$(stat -c%s "out/trusty_loader.bin")
-LoaderStart=0
-LoaderCount=$(((s + 511) / 512))
+# Drop debug info and other non-loadable contents, merge adjacent
+# segments and start each one page aligned in the file
+python3 tools/elfstrip.py ${BUILD_DIR}lk.elf ${BUILD_DIR}lk.elf
 
-echo s = $s
-echo LoaderCount = $LoaderCount
+# Set TRUSTY_LZ4=1 to ship the trusty segments LZ4 compressed
+TRUSTY_IMAGE=${BUILD_DIR}lk.elf
+if [ -n "${TRUSTY_LZ4}" ]; then
+    python3 tools/lz4pack.py ${BUILD_DIR}lk.elf ${BUILD_DIR}lk.lz4
+    TRUSTY_IMAGE=${BUILD_DIR}lk.lz4
+fi
 
-s=$(stat -c%s "out/lk.elf")
-TrustyStart=$((LoaderStart + LoaderCount))
-TrustyCount=$(((s + 511) / 512))
+# Set TRUSTY_SNAPSHOT=1 to ship lk prelinked for the runtime base, the
+# image above is kept behind it in case the base changes
+if [ -n "${TRUSTY_SNAPSHOT}" ]; then
+    python3 tools/prelink.py --fallback ${TRUSTY_IMAGE} ${BUILD_DIR}lk.elf ${BUILD_DIR}lk.snap
+    TRUSTY_IMAGE=${BUILD_DIR}lk.snap
+fi
 
-echo TrustyStart = $TrustyStart 
+# Set TRUSTY_MEASURE=1 to have the loader check the image against its
+# SHA-256 measurement before starting it
+if [ -n "${TRUSTY_MEASURE}" ]; then
+    python3 tools/measure.py --patch ${BUILD_DIR}trusty_loader.bin ${TRUSTY_IMAGE}
+fi
 
-# Build the loader binary
-
-dd if=${BUILD_DIR}trusty_loader.bin of=${BUILD_DIR}trusty_pkg.bin seek=$LoaderStart
-dd if=${BUILD_DIR}lk.elf of=${BUILD_DIR}trusty_pkg.bin seek=$TrustyStart
+# vSBL loads the package as the multiboot module named "trusty", next to
+# trusty_loader.bin. Set TRUSTY_EMBED=1 to append it to the loader
+# instead, in trusty_pkg.bin, and TRUSTY_PKG_ALIGN=2m to align the images
+# to 2M rather than 4K
+PKG_ARGS="--align ${TRUSTY_PKG_ALIGN:-4k} trusty=${TRUSTY_IMAGE}"
+if [ -n "${TRUSTY_EMBED}" ]; then
+    python3 tools/mkpkg.py --embed ${BUILD_DIR}trusty_loader.bin -o ${BUILD_DIR}trusty_pkg.bin ${PKG_ARGS}
+else
+    python3 tools/mkpkg.py -o ${BUILD_DIR}trusty.img ${PKG_ARGS}
+fi
@@ -0,0 +1,305 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+#include "cmdline.h"
+#include "util.h"
+
+/* 32 bit FNV-1a */
+#define CMDLINE_HASH_INIT       2166136261U
+#define CMDLINE_HASH_PRIME      16777619U
+
+#define CMDLINE_HASH_MASK       (CMDLINE_HASH_SLOTS - 1)
+
+#define IS_BLANK(c)     ((' ' == (c)) || ('\t' == (c)) || ('\n' == (c)) || \
+		('\r' == (c)))
+#define TOLOWER(x)      ((x) | 0x20)
+
+static boolean_t key_equal(const char *a, const char *b, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; ++i) {
+		if (a[i] != b[i])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* index the new param i, in place of an older one with the same key */
+static void cmdline_index(cmdline_t *cl, uint32_t i)
+{
+	const cmdline_param_t *param = &cl->params[i];
+	const cmdline_param_t *other;
+	uint32_t slot = cl->hashes[i] & CMDLINE_HASH_MASK;
+	uint32_t j;
+
+	while (cl->slots[slot]) {
+		j = cl->slots[slot] - 1U;
+		other = &cl->params[j];
+		if ((cl->hashes[j] == cl->hashes[i]) &&
+				(other->key_len == param->key_len) &&
+				key_equal(cl->str + other->key, cl->str + param->key,
+					param->key_len))
+			break;
+		slot = (slot + 1) & CMDLINE_HASH_MASK;
+	}
+
+	cl->slots[slot] = (uint16_t)(i + 1);
+}
+
+void cmdline_init(cmdline_t *cl, const char *str, uint32_t max_len)
+{
+	const char *end;
+	cmdline_param_t *param;
+	const char *key;
+	const char *value;
+	uint32_t key_len;
+	uint32_t value_len;
+	uint32_t hash;
+
+	if (max_len > CMDLINE_MAX_LEN)
+		max_len = CMDLINE_MAX_LEN;
+	end = str + max_len;
+
+	/* the params are written as they are found, only the slots must
+	 * start out free */
+	memset(cl->slots, 0, sizeof(cl->slots));
+	cl->str = str;
+	cl->count = 0;
+
+	while ((str < end) && *str) {
+		if (IS_BLANK(*str)) {
+			++str;
+			continue;
+		}
+
+		/* the key, hashed on the way */
+		key = str;
+		hash = CMDLINE_HASH_INIT;
+		while ((str < end) && *str && ('=' != *str) && !IS_BLANK(*str)) {
+			hash = (hash ^ (uint8_t)*str) * CMDLINE_HASH_PRIME;
+			++str;
+		}
+		key_len = (uint32_t)(str - key);
+
+		value = NULL;
+		value_len = 0;
+		if ((str < end) && ('=' == *str)) {
+			value = ++str;
+			if ((str < end) && ('"' == *str)) {
+				value = ++str;
+				while ((str < end) && *str && ('"' != *str))
+					++str;
+				value_len = (uint32_t)(str - value);
+				if ((str < end) && ('"' == *str))
+					++str;
+			} else {
+				while ((str < end) && *str && !IS_BLANK(*str))
+					++str;
+				value_len = (uint32_t)(str - value);
+			}
+		}
+
+		/* "=value" names nothing */
+		if (0 == key_len)
+			continue;
+
+		/* a param takes at least a byte and a blank, it always fits */
+		param = &cl->params[cl->count];
+		param->key = (uint16_t)(key - cl->str);
+		param->key_len = (uint16_t)key_len;
+		param->value = value ? (uint16_t)(value - cl->str) :
+			CMDLINE_NO_VALUE;
+		param->value_len = (uint16_t)value_len;
+		cl->hashes[cl->count] = hash;
+		cmdline_index(cl, cl->count);
+		cl->count++;
+	}
+
+	cl->len = (uint32_t)(str - cl->str);
+}
+
+const cmdline_param_t *cmdline_find(const cmdline_t *cl, const char *key)
+{
+	const cmdline_param_t *param;
+	uint32_t hash = CMDLINE_HASH_INIT;
+	uint32_t len, slot, i;
+
+	for (len = 0; key[len]; ++len)
+		hash = (hash ^ (uint8_t)key[len]) * CMDLINE_HASH_PRIME;
+
+	/* at most half the slots are used, there is always a free one */
+	for (slot = hash & CMDLINE_HASH_MASK; cl->slots[slot];
+			slot = (slot + 1) & CMDLINE_HASH_MASK) {
+		i = cl->slots[slot] - 1U;
+		param = &cl->params[i];
+		if ((cl->hashes[i] == hash) && (param->key_len == len) &&
+				key_equal(cl->str + param->key, key, len))
+			return param;
+	}
+
+	return NULL;
+}
+
+/* the value of key, NULL if the key is not there or has no value */
+static const char *cmdline_value(const cmdline_t *cl, const char *key,
+		uint32_t *len)
+{
+	const cmdline_param_t *param = cmdline_find(cl, key);
+
+	if (!param || (CMDLINE_NO_VALUE == param->value))
+		return NULL;
+
+	*len = param->value_len;
+	return cl->str + param->value;
+}
+
+/* the number at the start of str[0, len), *used set to its length.
+ * FALSE if there is none or it overflows. */
+static boolean_t parse_u64(const char *str, uint32_t len, uint32_t base,
+		uint64_t *value, uint32_t *used)
+{
+	uint64_t v = 0;
+	uint32_t start = 0;
+	uint32_t digit;
+	uint32_t i;
+
+	if (((16 == base) || (0 == base)) && (len > 2) && ('0' == str[0]) &&
+			('x' == TOLOWER(str[1]))) {
+		base = 16;
+		start = 2;
+	} else if (0 == base) {
+		base = 10;
+	}
+
+	for (i = start; i < len; ++i) {
+		if ((str[i] >= '0') && (str[i] <= '9'))
+			digit = str[i] - '0';
+		else if ((TOLOWER(str[i]) >= 'a') && (TOLOWER(str[i]) <= 'f'))
+			digit = TOLOWER(str[i]) - 'a' + 10;
+		else
+			break;
+
+		if (digit >= base)
+			break;
+		if (v > (~0ULL - digit) / base)
+			return FALSE;
+		v = v * base + digit;
+	}
+
+	if (i == start)
+		return FALSE;
+
+	*value = v;
+	*used = i;
+	return TRUE;
+}
+
+boolean_t cmdline_get_u64(const cmdline_t *cl, const char *key, uint32_t base,
+		uint64_t *value)
+{
+	const char *str;
+	uint64_t v;
+	uint32_t len = 0;
+	uint32_t used;
+
+	str = cmdline_value(cl, key, &len);
+	if (!str || !parse_u64(str, len, base, &v, &used) || (used != len))
+		return FALSE;
+
+	*value = v;
+	return TRUE;
+}
+
+static boolean_t word_equal(const char *str, uint32_t len, const char *word)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; ++i) {
+		if (TOLOWER(str[i]) != word[i])
+			return FALSE;
+	}
+
+	return '\0' == word[i];
+}
+
+boolean_t cmdline_get_bool(const cmdline_t *cl, const char *key,
+		boolean_t *value)
+{
+	/* chars, not pointers, nothing relocates the loader's data */
+	static const char words[][6] = {
+		"0", "n", "no", "off", "false",
+		"1", "y", "yes", "on", "true",
+	};
+	const cmdline_param_t *param = cmdline_find(cl, key);
+	uint32_t i;
+
+	if (!param)
+		return FALSE;
+
+	if (CMDLINE_NO_VALUE == param->value) {
+		*value = TRUE;
+		return TRUE;
+	}
+
+	for (i = 0; i < sizeof(words) / sizeof(words[0]); ++i) {
+		if (word_equal(cl->str + param->value, param->value_len,
+					words[i])) {
+			*value = (i >= 5);
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+boolean_t cmdline_get_size(const cmdline_t *cl, const char *key,
+		uint64_t *value)
+{
+	const char *str;
+	uint64_t v;
+	uint32_t len = 0;
+	uint32_t used;
+	uint32_t shift = 0;
+
+	str = cmdline_value(cl, key, &len);
+	if (!str || !parse_u64(str, len, 0, &v, &used))
+		return FALSE;
+
+	if (used + 1 == len) {
+		switch (TOLOWER(str[used])) {
+		case 'k':
+			shift = 10;
+			break;
+		case 'm':
+			shift = 20;
+			break;
+		case 'g':
+			shift = 30;
+			break;
+		default:
+			return FALSE;
+		}
+	} else if (used != len) {
+		return FALSE;
+	}
+
+	if (v > (~0ULL >> shift))
+		return FALSE;
+
+	*value = v << shift;
+	return TRUE;
+}
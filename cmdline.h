@@ -0,0 +1,82 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef _CMDLINE_H_
+#define _CMDLINE_H_
+
+#include "trusty_loader_base.h"
+#include "string.h"
+
+/*
+ * The multiboot cmdline, split once into key=value parameters. Parameters
+ * are separated by blanks, a value may be put in double quotes to hold
+ * blanks itself, a key without '=' has no value. The keys are hashed into
+ * an open addressed table, so a lookup costs one hash of the key asked
+ * for, whatever the length of the cmdline. A key given twice takes the
+ * last value, as in Linux.
+ *
+ * The table holds as many parameters as a MAX_STR_LEN cmdline can have,
+ * one byte and a blank each, so none is ever left out.
+ */
+#define CMDLINE_MAX_LEN         MAX_STR_LEN
+#define CMDLINE_MAX_PARAMS      (CMDLINE_MAX_LEN / 2)
+#define CMDLINE_HASH_SLOTS      CMDLINE_MAX_LEN /* power of 2, at most half used */
+
+#define CMDLINE_NO_VALUE        0xFFFF
+
+/* offsets into the cmdline, value is CMDLINE_NO_VALUE if the key has no '=' */
+typedef struct {
+	uint16_t	key;
+	uint16_t	key_len;
+	uint16_t	value;
+	uint16_t	value_len;
+} cmdline_param_t;
+
+/* 32K, too big for the loader stack */
+typedef struct {
+	cmdline_param_t	params[CMDLINE_MAX_PARAMS];
+	uint32_t	hashes[CMDLINE_MAX_PARAMS];
+	uint16_t	slots[CMDLINE_HASH_SLOTS];      /* param + 1, 0 if free */
+	const char	*str;
+	uint32_t	len;
+	uint32_t	count;
+} cmdline_t;
+
+/* split the cmdline at str, at most max_len bytes and no more than
+ * CMDLINE_MAX_LEN, into cl. str must stay where it is */
+void cmdline_init(cmdline_t *cl, const char *str, uint32_t max_len);
+
+/* the parameter called key, NULL if there is none */
+const cmdline_param_t *cmdline_find(const cmdline_t *cl, const char *key);
+
+/*
+ * Typed values. Each returns FALSE, leaving *value alone, if the key is
+ * not there or its value does not parse as a whole.
+ *
+ *   u64   base 10 or 16, 16 takes an optional 0x, 0 means 16 after a 0x
+ *         and 10 otherwise
+ *   bool  1/y/yes/on/true or 0/n/no/off/false, a key alone is TRUE
+ *   size  a decimal or 0x number of bytes, then K, M or G for 2^10,
+ *         2^20 or 2^30 of them
+ */
+boolean_t cmdline_get_u64(const cmdline_t *cl, const char *key, uint32_t base,
+		uint64_t *value);
+boolean_t cmdline_get_bool(const cmdline_t *cl, const char *key,
+		boolean_t *value);
+boolean_t cmdline_get_size(const cmdline_t *cl, const char *key,
+		uint64_t *value);
+
+#endif
@@ -0,0 +1,207 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+#include "cpu.h"
+
+#define CR0_MP                  (1ULL << 1)
+#define CR0_EM                  (1ULL << 2)
+#define CR0_TS                  (1ULL << 3)
+
+#define CR4_OSFXSR              (1ULL << 9)
+#define CR4_OSXMMEXCPT          (1ULL << 10)
+#define CR4_OSXSAVE             (1ULL << 18)
+
+#define XCR0_X87                (1ULL << 0)
+#define XCR0_SSE                (1ULL << 1)
+#define XCR0_AVX                (1ULL << 2)
+#define XCR0_OPMASK             (1ULL << 5)
+#define XCR0_ZMM_HI256          (1ULL << 6)
+#define XCR0_HI16_ZMM           (1ULL << 7)
+#define XCR0_AVX512             (XCR0_OPMASK | XCR0_ZMM_HI256 | XCR0_HI16_ZMM)
+
+static uint32_t cpu_features[CPU_FEATURE_WORDS];
+static uint32_t simd_level;
+
+static boolean_t state_saved;
+static uint64_t saved_cr0;
+static uint64_t saved_cr4;
+static uint64_t saved_xcr0;
+
+void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx,
+		uint32_t *ecx, uint32_t *edx)
+{
+	__asm__ __volatile__ (
+		"cpuid"
+		: "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+		: "a" (leaf), "c" (subleaf));
+}
+
+uint64_t rdmsr(uint32_t msr)
+{
+	uint32_t lo, hi;
+
+	__asm__ __volatile__ ("rdmsr" : "=a" (lo), "=d" (hi) : "c" (msr));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+uint64_t rdtsc(void)
+{
+	uint32_t lo, hi;
+
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi) :: "memory");
+	return ((uint64_t)hi << 32) | lo;
+}
+
+static uint64_t read_cr0(void)
+{
+	uint64_t val;
+
+	__asm__ __volatile__ ("movq %%cr0, %0" : "=r" (val));
+	return val;
+}
+
+static void write_cr0(uint64_t val)
+{
+	__asm__ __volatile__ ("movq %0, %%cr0" :: "r" (val) : "memory");
+}
+
+static uint64_t read_cr4(void)
+{
+	uint64_t val;
+
+	__asm__ __volatile__ ("movq %%cr4, %0" : "=r" (val));
+	return val;
+}
+
+static void write_cr4(uint64_t val)
+{
+	__asm__ __volatile__ ("movq %0, %%cr4" :: "r" (val) : "memory");
+}
+
+static uint64_t xgetbv(uint32_t index)
+{
+	uint32_t lo, hi;
+
+	__asm__ __volatile__ ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (index));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+static void xsetbv(uint32_t index, uint64_t val)
+{
+	__asm__ __volatile__ ("xsetbv" ::
+		"c" (index), "a" ((uint32_t)val), "d" ((uint32_t)(val >> 32)));
+}
+
+static void cpu_probe(void)
+{
+	uint32_t max_leaf, max_ext_leaf;
+	uint32_t eax, ebx, ecx, edx;
+
+	cpuid(0, 0, &max_leaf, &ebx, &ecx, &edx);
+
+	cpuid(1, 0, &eax, &ebx, &cpu_features[CPUID_1_ECX],
+			&cpu_features[CPUID_1_EDX]);
+
+	if (max_leaf >= 7)
+		cpuid(7, 0, &eax, &cpu_features[CPUID_7_EBX],
+				&cpu_features[CPUID_7_ECX], &cpu_features[CPUID_7_EDX]);
+
+	cpuid(0x80000000, 0, &max_ext_leaf, &ebx, &ecx, &edx);
+	if (max_ext_leaf >= 0x80000001)
+		cpuid(0x80000001, 0, &eax, &ebx, &cpu_features[CPUID_80000001_ECX],
+				&cpu_features[CPUID_80000001_EDX]);
+}
+
+boolean_t cpu_has_feature(uint32_t feature)
+{
+	if (feature >= CPU_FEATURE_WORDS * 32)
+		return FALSE;
+
+	return (cpu_features[feature / 32] >> (feature % 32)) & 1;
+}
+
+uint32_t cpu_simd_level(void)
+{
+	return simd_level;
+}
+
+void cpu_init(void)
+{
+	uint64_t cr0, cr4;
+	uint64_t xcr0 = 0;
+	uint64_t xcr0_supported;
+	uint32_t eax, ebx, ecx, edx;
+
+	cpu_probe();
+
+	cr0 = read_cr0();
+	cr4 = read_cr4();
+	saved_cr0 = cr0;
+	saved_cr4 = cr4;
+	if (cr4 & CR4_OSXSAVE)
+		saved_xcr0 = xgetbv(0);
+	state_saved = TRUE;
+
+	/* SSE2 is architectural on x86-64, only the OS enable bits are
+	 * needed: no x87 emulation, no lazy FPU switching.
+	 */
+	cr0 = (cr0 & ~(CR0_EM | CR0_TS)) | CR0_MP;
+	cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+	write_cr0(cr0);
+	write_cr4(cr4);
+	simd_level = SIMD_SSE2;
+
+	if (!cpu_has_feature(X86_FEATURE_XSAVE))
+		return;
+
+	write_cr4(cr4 | CR4_OSXSAVE);
+
+	/* enable only the state components the CPU supports */
+	cpuid(0xD, 0, &eax, &ebx, &ecx, &edx);
+	xcr0_supported = ((uint64_t)edx << 32) | eax;
+
+	if (cpu_has_feature(X86_FEATURE_AVX) &&
+		((xcr0_supported & XCR0_AVX) == XCR0_AVX)) {
+		xcr0 = XCR0_X87 | XCR0_SSE | XCR0_AVX;
+
+		if (cpu_has_feature(X86_FEATURE_AVX512F) &&
+			((xcr0_supported & XCR0_AVX512) == XCR0_AVX512))
+			xcr0 |= XCR0_AVX512;
+	} else {
+		xcr0 = XCR0_X87 | XCR0_SSE;
+	}
+	xsetbv(0, xcr0);
+
+	if ((xcr0 & XCR0_AVX512) && cpu_has_feature(X86_FEATURE_AVX512F))
+		simd_level = SIMD_AVX512;
+	else if ((xcr0 & XCR0_AVX) && cpu_has_feature(X86_FEATURE_AVX2))
+		simd_level = SIMD_AVX2;
+}
+
+void cpu_restore(void)
+{
+	if (!state_saved)
+		return;
+
+	/* XCR0 can only be written while CR4.OSXSAVE is still set */
+	if (saved_cr4 & CR4_OSXSAVE)
+		xsetbv(0, saved_xcr0);
+
+	write_cr4(saved_cr4);
+	write_cr0(saved_cr0);
+
+	simd_level = SIMD_NONE;
+	state_saved = FALSE;
+}
@@ -0,0 +1,70 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef _CPU_H_
+#define _CPU_H_
+
+#include "trusty_loader_base.h"
+
+/* cpuid registers cached by cpu_init(), a feature is word * 32 + bit */
+#define CPUID_1_ECX             0
+#define CPUID_1_EDX             1
+#define CPUID_7_EBX             2
+#define CPUID_7_ECX             3
+#define CPUID_7_EDX             4
+#define CPUID_80000001_ECX      5
+#define CPUID_80000001_EDX      6
+#define CPU_FEATURE_WORDS       7
+
+#define CPU_FEATURE(word, bit)  ((word) * 32 + (bit))
+
+#define X86_FEATURE_MTRR        CPU_FEATURE(CPUID_1_EDX, 12)
+#define X86_FEATURE_PAT         CPU_FEATURE(CPUID_1_EDX, 16)
+#define X86_FEATURE_SSE2        CPU_FEATURE(CPUID_1_EDX, 26)
+#define X86_FEATURE_SSSE3       CPU_FEATURE(CPUID_1_ECX, 9)
+#define X86_FEATURE_SSE4_1      CPU_FEATURE(CPUID_1_ECX, 19)
+#define X86_FEATURE_AESNI       CPU_FEATURE(CPUID_1_ECX, 25)
+#define X86_FEATURE_XSAVE       CPU_FEATURE(CPUID_1_ECX, 26)
+#define X86_FEATURE_AVX         CPU_FEATURE(CPUID_1_ECX, 28)
+#define X86_FEATURE_AVX2        CPU_FEATURE(CPUID_7_EBX, 5)
+#define X86_FEATURE_ERMS        CPU_FEATURE(CPUID_7_EBX, 9)
+#define X86_FEATURE_AVX512F     CPU_FEATURE(CPUID_7_EBX, 16)
+#define X86_FEATURE_SHA_NI      CPU_FEATURE(CPUID_7_EBX, 29)
+#define X86_FEATURE_FSRM        CPU_FEATURE(CPUID_7_EDX, 4)
+#define X86_FEATURE_PDPE1GB     CPU_FEATURE(CPUID_80000001_EDX, 26)
+
+/* widest vector unit the loader may use, in increasing order */
+#define SIMD_NONE               0
+#define SIMD_SSE2               1
+#define SIMD_AVX2               2
+#define SIMD_AVX512             3
+
+void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx,
+		uint32_t *ecx, uint32_t *edx);
+uint64_t rdmsr(uint32_t msr);
+uint64_t rdtsc(void);
+
+/* probe cpuid and enable SSE/AVX state (CR0, CR4.OSFXSR, CR4.OSXSAVE, XCR0)
+ * for the loader itself. cpu_restore() puts the original state back before
+ * control is handed to Linux.
+ */
+void cpu_init(void);
+void cpu_restore(void);
+
+boolean_t cpu_has_feature(uint32_t feature);
+uint32_t cpu_simd_level(void);
+
+#endif
@@ -16,6 +16,195 @@
 #include "print.h"
 #include "util.h"
 #include "elf_ld.h"
+#include "hypercall.h"
+#include "platform.h"
+#include "lz4.h"
+#include "alternative.h"
+#include "sha256.h"
+#include "cpu.h"
+#include "timeline.h"
+
+/* apply a DT_RELR table, every word it names is a link time address */
+static void elf64_apply_relr(const elf64_relr_t *relr, uint64_t relr_sz,
+        uint64_t relocation_offset)
+{
+    uint64_t *where = NULL;
+    uint64_t bitmap;
+    uint64_t i, j;
+
+    for (i = 0; i < relr_sz / sizeof(elf64_relr_t); ++i) {
+        if (0 == (relr[i] & 1)) {
+            where = (uint64_t *)(relr[i] + relocation_offset);
+            *where++ += relocation_offset;
+            continue;
+        }
+
+        for (bitmap = relr[i] >> 1, j = 0; bitmap; bitmap >>= 1, ++j) {
+            if (bitmap & 1)
+                where[j] += relocation_offset;
+        }
+        where += 63;
+    }
+}
+
+/* apply the run of R_X86_64_RELATIVE entries starting at rela, return how
+ * many there were. linkers emit them first and sorted by address (-z
+ * combreloc, DT_RELACOUNT counts them), so the stores already walk each
+ * target page once and in order. the loop only has to keep the table
+ * streaming in: four entries per round, prefetching 16 entries ahead.
+ * the stores are scattered 8-byte writes, a vector unit can't batch them.
+ */
+static uint64_t elf64_apply_relative(const elf64_rela_t *rela, uint64_t count,
+        uint64_t relocation_offset)
+{
+    uint64_t i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        if ((R_X86_64_RELATIVE != (rela[i].r_info & 0xFF)) ||
+                (R_X86_64_RELATIVE != (rela[i + 1].r_info & 0xFF)) ||
+                (R_X86_64_RELATIVE != (rela[i + 2].r_info & 0xFF)) ||
+                (R_X86_64_RELATIVE != (rela[i + 3].r_info & 0xFF)))
+            break;
+
+        /* clamped, an address past the table is undefined even unread */
+        __asm__ __volatile__ ("prefetcht0 %0" ::
+                "m" (rela[MIN(i + 16, count - 1)]));
+
+        *(uint64_t *)(rela[i].r_offset + relocation_offset) =
+            rela[i].r_addend + relocation_offset;
+        *(uint64_t *)(rela[i + 1].r_offset + relocation_offset) =
+            rela[i + 1].r_addend + relocation_offset;
+        *(uint64_t *)(rela[i + 2].r_offset + relocation_offset) =
+            rela[i + 2].r_addend + relocation_offset;
+        *(uint64_t *)(rela[i + 3].r_offset + relocation_offset) =
+            rela[i + 3].r_addend + relocation_offset;
+    }
+
+    for (; i < count && R_X86_64_RELATIVE == (rela[i].r_info & 0xFF); ++i) {
+        *(uint64_t *)(rela[i].r_offset + relocation_offset) =
+            rela[i].r_addend + relocation_offset;
+    }
+
+    return i;
+}
+
+/* S for a symbolic relocation. symbol 0 stands for "no symbol", an
+ * undefined weak symbol resolves to 0 and anything else undefined is an
+ * error: there is nothing the image could be linked against.
+ */
+static boolean_t elf64_symbol_value(const elf64_sym_t *symtab, uint64_t r_info,
+        uint64_t relocation_offset, uint64_t *value)
+{
+    const elf64_sym_t *sym;
+    uint32_t symtab_idx = (uint32_t)(r_info >> 32);
+
+    if (0 == symtab_idx) {
+        *value = 0;
+        return TRUE;
+    }
+
+    if (NULL == symtab) {
+        printf("trusty loader: symbol %d without a symbol table\n", symtab_idx);
+        return FALSE;
+    }
+
+    sym = &symtab[symtab_idx];
+    if (SHN_UNDEF == sym->st_shndx) {
+        if (STB_WEAK == ELF64_ST_BIND(sym->st_info)) {
+            *value = 0;
+            return TRUE;
+        }
+        printf("trusty loader: symbol %d is undefined\n", symtab_idx);
+        return FALSE;
+    }
+
+    *value = sym->st_value;
+    if (SHN_ABS != sym->st_shndx)
+        *value += relocation_offset;
+
+    return TRUE;
+}
+
+/* apply one DT_RELA or DT_JMPREL table. R_X86_64_IRELATIVE entries are
+ * only counted, their resolvers may read data other entries relocate.
+ */
+static boolean_t elf64_apply_rela(const elf64_rela_t *rela, uint64_t count,
+        const elf64_sym_t *symtab, uint64_t relocation_offset,
+        uint64_t *irelative_count)
+{
+    uint64_t i;
+
+    for (i = 0; i < count; ) {
+        uint64_t target_addr;
+        uint64_t value;
+
+        if (R_X86_64_RELATIVE == (rela[i].r_info & 0xFF)) {
+            i += elf64_apply_relative(&rela[i], count - i, relocation_offset);
+            continue;
+        }
+
+        target_addr = rela[i].r_offset + relocation_offset;
+
+        switch (rela[i].r_info & 0xFF) {
+            /* S + A */
+            case R_X86_64_32:
+            case R_X86_64_64:
+                if (!elf64_symbol_value(symtab, rela[i].r_info,
+                            relocation_offset, &value))
+                    return FALSE;
+                value += rela[i].r_addend;
+                if (R_X86_64_64 == (rela[i].r_info & 0xFF)) {
+                    *(uint64_t *)target_addr = value;
+                } else if (value >> 32) {
+                    printf("trusty loader: R_X86_64_32 at 0x%lx overflows\n",
+                            target_addr);
+                    return FALSE;
+                } else {
+                    *(uint32_t *)target_addr = (uint32_t)value;
+                }
+                break;
+            /* S */
+            case R_X86_64_GLOB_DAT:
+            case R_X86_64_JMP_SLOT:
+                if (!elf64_symbol_value(symtab, rela[i].r_info,
+                            relocation_offset, &value))
+                    return FALSE;
+                *(uint64_t *)target_addr = value;
+                break;
+            case R_X86_64_IRELATIVE:
+                ++*irelative_count;
+                break;
+            case 0:        /* do nothing */
+                break;
+            default:
+                printf("trusty loader: Unsupported Relocation 0x%lx\n",
+                        rela[i].r_info & 0xFF);
+                return FALSE;
+        }
+        ++i;
+    }
+
+    return TRUE;
+}
+
+/* R_X86_64_IRELATIVE: the target gets what the resolver at B + A returns.
+ * resolvers run on the loader stack with SSE/AVX state enabled by
+ * cpu_init(), so they can probe cpuid and pick trusty's fastest routines.
+ */
+static void elf64_apply_irelative(const elf64_rela_t *rela, uint64_t count,
+        uint64_t relocation_offset)
+{
+    uint64_t (*resolver)(void);
+    uint64_t i;
+
+    for (i = 0; i < count; ++i) {
+        if (R_X86_64_IRELATIVE != (rela[i].r_info & 0xFF))
+            continue;
+
+        resolver = (uint64_t (*)(void))(rela[i].r_addend + relocation_offset);
+        *(uint64_t *)(rela[i].r_offset + relocation_offset) = resolver();
+    }
+}
 
 static boolean_t elf64_update_rela_section(uint16_t e_type, uint64_t relocation_offset,
         elf64_dyn_t *dyn_section, uint64_t dyn_section_sz)
@@ -23,8 +212,15 @@ static boolean_t elf64_update_rela_section(uint16_t e_type, uint64_t relocation_
     elf64_rela_t *rela = NULL;
     uint64_t rela_sz = 0;
     uint64_t rela_entsz = 0;
+    elf64_rela_t *jmprel = NULL;
+    uint64_t jmprel_sz = 0;
+    uint64_t pltrel = DT_RELA;
+    elf64_relr_t *relr = NULL;
+    uint64_t relr_sz = 0;
+    uint64_t relr_entsz = 0;
     elf64_sym_t *symtab = NULL;
     uint64_t symtab_entsz = 0;
+    uint64_t irelative_count = 0;
     uint64_t i;
     uint64_t d_tag = 0;
 
@@ -33,7 +229,7 @@ static boolean_t elf64_update_rela_section(uint16_t e_type, uint64_t relocation_
         return FALSE;
     }
 
-    /* locate rela address, size, entry size */
+    /* locate rela/jmprel/relr address, size, entry size */
     for (i = 0; i < dyn_section_sz / sizeof(elf64_dyn_t); ++i) {
         d_tag = dyn_section[i].d_tag;
 
@@ -44,6 +240,20 @@ static boolean_t elf64_update_rela_section(uint16_t e_type, uint64_t relocation_
             rela_sz = dyn_section[i].d_un.d_val;
         } else if(DT_RELAENT == d_tag) {
             rela_entsz = dyn_section[i].d_un.d_val;
+        } else if(DT_JMPREL == d_tag) {
+            jmprel = (elf64_rela_t *)(uint64_t)(dyn_section[i].d_un.d_ptr +
+                    relocation_offset);
+        } else if(DT_PLTRELSZ == d_tag) {
+            jmprel_sz = dyn_section[i].d_un.d_val;
+        } else if(DT_PLTREL == d_tag) {
+            pltrel = dyn_section[i].d_un.d_val;
+        } else if(DT_RELR == d_tag) {
+            relr = (elf64_relr_t *)(uint64_t)(dyn_section[i].d_un.d_ptr +
+                    relocation_offset);
+        } else if(DT_RELRSZ == d_tag) {
+            relr_sz = dyn_section[i].d_un.d_val;
+        } else if(DT_RELRENT == d_tag) {
+            relr_entsz = dyn_section[i].d_un.d_val;
         } else if(DT_SYMTAB == d_tag) {
             symtab = (elf64_sym_t *)(uint64_t)(dyn_section[i].d_un.d_ptr +
                     relocation_offset);
@@ -54,9 +264,15 @@ static boolean_t elf64_update_rela_section(uint16_t e_type, uint64_t relocation_
         }
     }
 
-    if (NULL == rela || 0 == rela_sz || NULL == symtab
-            || sizeof(elf64_rela_t) != rela_entsz
-            || sizeof(elf64_sym_t) != symtab_entsz) {
+    if (NULL == rela)
+        rela_sz = 0;
+    if (NULL == jmprel)
+        jmprel_sz = 0;
+    if (NULL == relr)
+        relr_sz = 0;
+
+    if ((0 == rela_sz && 0 == jmprel_sz && 0 == relr_sz)
+            || (0 != rela_sz && sizeof(elf64_rela_t) != rela_entsz)) {
 
         if (e_type == ET_DYN) {
             printf("trusty loader: DYN type relocation section is optional\n");
@@ -67,29 +283,36 @@ static boolean_t elf64_update_rela_section(uint16_t e_type, uint64_t relocation_
         }
     }
 
-    for (i = 0; i < rela_sz / rela_entsz; ++i) {
-        uint64_t *target_addr = (uint64_t *)(uint64_t)(rela[i].r_offset +
-                relocation_offset);
-        uint32_t symtab_idx;
+    if (NULL != symtab && sizeof(elf64_sym_t) != symtab_entsz) {
+        printf("trusty loader: invalid symbol entry size %ld\n", symtab_entsz);
+        return FALSE;
+    }
 
-        switch (rela[i].r_info & 0xFF) {
-            /* Formula for R_x86_64_32 and R_X86_64_64 are same: S + A  */
-            case R_X86_64_32:
-            case R_X86_64_64:
-                *target_addr = rela[i].r_addend + relocation_offset;
-                symtab_idx = (uint32_t)(rela[i].r_info >> 32);
-                *target_addr += symtab[symtab_idx].st_value;
-                break;
-            case R_X86_64_RELATIVE:
-                *target_addr = rela[i].r_addend + relocation_offset;
-                break;
-            case 0:        /* do nothing */
-                break;
-            default:
-                printf("trusty loader: Unsupported Relocation %#x\n",
-                        rela[i].r_info & 0xFF);
-                return FALSE;
+    if (0 != jmprel_sz && DT_RELA != pltrel) {
+        printf("trusty loader: plt relocations must be rela\n");
+        return FALSE;
+    }
+
+    if (0 != relr_sz) {
+        if (sizeof(elf64_relr_t) != relr_entsz) {
+            printf("trusty loader: invalid relr entry size %ld\n", relr_entsz);
+            return FALSE;
         }
+
+        elf64_apply_relr(relr, relr_sz, relocation_offset);
+    }
+
+    if (!elf64_apply_rela(rela, rela_sz / sizeof(elf64_rela_t), symtab,
+                relocation_offset, &irelative_count) ||
+            !elf64_apply_rela(jmprel, jmprel_sz / sizeof(elf64_rela_t), symtab,
+                relocation_offset, &irelative_count))
+        return FALSE;
+
+    if (0 != irelative_count) {
+        elf64_apply_irelative(rela, rela_sz / sizeof(elf64_rela_t),
+                relocation_offset);
+        elf64_apply_irelative(jmprel, jmprel_sz / sizeof(elf64_rela_t),
+                relocation_offset);
     }
 
     return TRUE;
@@ -115,14 +338,340 @@ static void elf64_update_segment_table(uint64_t runtime_addr,
     }
 }
 
-static boolean_t elf64_load_executable(uint64_t loadtime_addr, uint64_t runtime_addr,
-        uint64_t *runtime_entry)
+#ifdef TRUSTY_XIP
+/* text relocations would have to be written into the package pages */
+static boolean_t elf64_has_textrel(elf64_dyn_t *dyn_section,
+        uint64_t dyn_section_sz)
+{
+    uint64_t i;
+
+    for (i = 0; i < dyn_section_sz / sizeof(elf64_dyn_t); ++i) {
+        if (DT_NULL == dyn_section[i].d_tag)
+            break;
+
+        if (DT_TEXTREL == dyn_section[i].d_tag)
+            return TRUE;
+
+        if ((DT_FLAGS == dyn_section[i].d_tag) &&
+                (dyn_section[i].d_un.d_val & DF_TEXTREL))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* a read-only segment can be mapped in place when both its file data and
+ * its runtime address are page aligned, it has no bss, and the pages it
+ * maps are not shared with any other segment. the segment holding the elf
+ * header is always copied, its program headers are patched at runtime.
+ */
+static boolean_t elf64_segment_can_remap(elf64_ehdr_t *ehdr, uint8_t *phdrtab,
+        elf64_phdr_t *phdr, uint64_t loadtime_addr, uint64_t relocation_offset)
+{
+    elf64_phdr_t *other;
+    uint64_t start = phdr->p_paddr + relocation_offset;
+    uint64_t end = start + PAGE_ALIGN_4K(phdr->p_filesz);
+    uint64_t other_start;
+    uint16_t cnt;
+
+    if ((phdr->p_flags & PF_W) || (0 == phdr->p_offset) ||
+            (phdr->p_filesz != phdr->p_memsz))
+        return FALSE;
+
+    if (((loadtime_addr + phdr->p_offset) | start) & PAGE_4K_MASK)
+        return FALSE;
+
+    for (cnt = 0; cnt < (uint16_t)ehdr->e_phnum; ++cnt) {
+        other = (elf64_phdr_t *)GET_PHDR(ehdr, phdrtab, cnt);
+
+        if (other == phdr || PT_LOAD != other->p_type || 0 == other->p_memsz)
+            continue;
+
+        other_start = other->p_paddr + relocation_offset;
+        if ((other_start < end) && (other_start + other->p_memsz > start))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* *owned is set when the hypervisor confirms the normal world lost the
+ * pages, see TRUSTY_REMAP_OWNED */
+static boolean_t elf64_remap_segment(uint64_t src, uint64_t dst, uint64_t size,
+        boolean_t *owned)
+{
+    trusty_remap_param_t param;
+
+    param.src_gpa = src;
+    param.dst_gpa = dst;
+    param.size = PAGE_ALIGN_4K(size);
+    param.flags = TRUSTY_REMAP_EXCLUSIVE;
+    param.reserved = 0;
+
+    if (0 != platform_hypercall(HC_REMAP_TRUSTY_PAGES, (uint64_t)&param))
+        return FALSE;
+
+    *owned = (param.flags & TRUSTY_REMAP_OWNED) ? TRUE : FALSE;
+    return TRUE;
+}
+#endif
+
+static boolean_t elf_name_equal(const char *a, const char *b)
+{
+    while (*a && *a == *b) {
+        ++a;
+        ++b;
+    }
+
+    return *a == *b;
+}
+
+/* section headers are optional, the loader itself only needs the program
+ * headers. file_size bounds what can be read at loadtime_addr, an LZ4
+ * image only carries the headers in its prefix.
+ */
+static elf64_shdr_t *elf64_find_section(uint64_t loadtime_addr,
+        uint64_t file_size, const char *name)
 {
+    elf64_ehdr_t *ehdr = (elf64_ehdr_t *)loadtime_addr;
+    elf64_shdr_t *shdr;
+    elf64_shdr_t *shstrtab;
+    uint8_t *shdrtab;
+    uint16_t i;
+
+    if ((0 == ehdr->e_shoff) || (ehdr->e_shstrndx >= ehdr->e_shnum) ||
+            (sizeof(elf64_shdr_t) != ehdr->e_shentsize) ||
+            (ehdr->e_shoff + (uint64_t)ehdr->e_shnum * ehdr->e_shentsize >
+                file_size))
+        return NULL;
+
+    shdrtab = (uint8_t *)(loadtime_addr + ehdr->e_shoff);
+    shstrtab = (elf64_shdr_t *)GET_SHDR(ehdr, shdrtab, ehdr->e_shstrndx);
+    if ((shstrtab->sh_offset + shstrtab->sh_size > file_size) ||
+            (0 == shstrtab->sh_size) ||
+            (0 != *(char *)(loadtime_addr + shstrtab->sh_offset +
+                            shstrtab->sh_size - 1)))
+        return NULL;
+
+    for (i = 0; i < ehdr->e_shnum; ++i) {
+        shdr = (elf64_shdr_t *)GET_SHDR(ehdr, shdrtab, i);
+        if ((shdr->sh_name < shstrtab->sh_size) && elf_name_equal(name,
+                    (const char *)(loadtime_addr + shstrtab->sh_offset +
+                        shdr->sh_name)))
+            return shdr;
+    }
+
+    return NULL;
+}
+
+/* patch trusty text for this CPU, start is the loaded table */
+static boolean_t elf_apply_alternatives(uint64_t start, uint64_t size,
+        uint64_t image_base, uint64_t image_size)
+{
+    uint32_t applied;
+
+    if ((start < image_base) || (size > image_size) ||
+            (start - image_base > image_size - size)) {
+        printf("trusty loader: alternatives table is outside the image\n");
+        return FALSE;
+    }
+
+    if (!apply_alternatives(start, size, image_base, image_size, &applied))
+        return FALSE;
+
+    printf("trusty loader: %d of %d alternatives applied\n", applied,
+            (uint32_t)(size / sizeof(alt_instr_t)));
+    return TRUE;
+}
+
+/* clear [start, start + size), except for the whole pages that lie inside
+ * the memory range the hypervisor already handed over zero-filled. the
+ * partial head and tail pages may share a page with loaded data, so they
+ * are always cleared.
+ */
+static void elf64_clear_bss(uint64_t start, uint64_t size,
+        elf_load_info_t *info)
+{
+    uint64_t end = start + size;
+    uint64_t skip_start;
+    uint64_t skip_end;
+
+    skip_start = PAGE_ALIGN_4K(MAX(start, info->zeroed_base));
+    skip_end = ALIGN_B(MIN(end, info->zeroed_base + info->zeroed_size),
+            PAGE_4K_SIZE);
+
+    if (0 == info->zeroed_size || skip_start >= skip_end) {
+        memset_stream((void *)start, 0, size);
+        info->zeroed_bytes += size;
+        return;
+    }
+
+    memset_stream((void *)start, 0, skip_start - start);
+    memset_stream((void *)skip_end, 0, end - skip_end);
+
+    info->zeroed_bytes += (skip_start - start) + (end - skip_end);
+    info->zero_skipped_bytes += skip_end - skip_start;
+}
+
+/* list a loaded segment for trusty's page tables */
+static void elf_record_segment(elf_load_info_t *info, uint64_t base,
+        uint64_t size, uint32_t p_flags)
+{
+    elf_segment_info_t *seg;
+
+    if (info->segment_count >= ELF_MAX_LOAD_SEGMENTS)
+        return;
+
+    seg = &info->segments[info->segment_count++];
+    seg->base = base;
+    seg->size = PAGE_ALIGN_4K(size);
+    seg->flags = p_flags & (PF_X | PF_W | PF_R);
+    seg->reserved = 0;
+
+    if (PAGE_ALIGN_2M(base) + PAGE_2M_SIZE <= base + seg->size)
+        seg->flags |= ELF_SEG_LARGE_PAGE;
+}
+
+/* the ELF header with the section header fields cleared and the program
+ * headers. lz4pack.py moves the section headers, the measurement of an
+ * ELF file and of its LZ4 image is the same.
+ */
+static void elf64_measure_headers(sha256_ctx_t *ctx, const elf64_ehdr_t *ehdr,
+        const uint8_t *phdrtab)
+{
+    elf64_ehdr_t hdr;
+
+    memcpy(&hdr, ehdr, sizeof(hdr));
+    hdr.e_shoff = 0;
+    hdr.e_shentsize = 0;
+    hdr.e_shnum = 0;
+    hdr.e_shstrndx = 0;
+
+    sha256_update(ctx, &hdr, sizeof(hdr));
+    sha256_update(ctx, phdrtab,
+            (uint64_t)ehdr->e_phnum * ehdr->e_phentsize);
+}
+
+/* the zero fill of a PT_LOAD segment, p_memsz past its file contents, as a
+ * 64 bit little endian size right after them */
+static void elf64_measure_bss(sha256_ctx_t *ctx, uint64_t size)
+{
+    sha256_update(ctx, &size, sizeof(size));
+}
+
+static boolean_t elf_check_digest(sha256_ctx_t *ctx, const uint8_t *expected,
+        const char *what)
+{
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    uint8_t diff = 0;
+    uint32_t i;
+
+    sha256_final(ctx, digest);
+
+    for (i = 0; i < SHA256_DIGEST_SIZE; ++i)
+        diff |= digest[i] ^ expected[i];
+
+    if (0 != diff) {
+        printf("trusty loader: %s measurement mismatch\n", what);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* put the file contents of one PT_LOAD segment at dest, either by copying
+ * them from the ELF file or by decompressing the LZ4 blocks that cover it.
+ * the blocks must lie within the image_size bytes at lz4.
+ * with hash set they are measured on the way: a copy is hashed as it is
+ * read, a decompressed block right after it was written, while it is still
+ * in the cache. the blocks have to come in file order, each one starting
+ * where the last one ended, so every byte of the segment is written once.
+ */
+static boolean_t elf64_load_segment(uint64_t loadtime_addr,
+        uint64_t image_size, const elf_lz4_hdr_t *lz4, elf64_phdr_t *phdr,
+        uint64_t filesz, uint64_t dest, sha256_ctx_t *hash,
+        elf_load_info_t *info)
+{
+    const elf_lz4_block_t *block;
+    const void *data;
+    uint64_t offset;
+    uint64_t covered = 0;
+    uint32_t i;
+
+    if (NULL == lz4) {
+        data = (const void *)(loadtime_addr + phdr->p_offset);
+        if (hash)
+            sha256_update_copy(hash, (void *)dest, data, filesz);
+        else
+            memcpy_stream((void *)dest, data, filesz);
+        info->copied_bytes += filesz;
+        return TRUE;
+    }
+
+    block = (const elf_lz4_block_t *)(lz4 + 1);
+    for (i = 0; i < lz4->block_count; ++i, ++block) {
+        if ((block->file_offset < phdr->p_offset) ||
+                (block->file_offset >= phdr->p_offset + filesz))
+            continue;
+
+        offset = block->file_offset - phdr->p_offset;
+        if (block->raw_size > filesz - offset) {
+            printf("trusty loader: lz4 block %d exceeds its segment\n", i);
+            return FALSE;
+        }
+
+        if (offset != covered) {
+            printf("trusty loader: lz4 block %d is out of order\n", i);
+            return FALSE;
+        }
+
+        if ((block->data_offset > image_size) ||
+                (block->comp_size > image_size - block->data_offset)) {
+            printf("trusty loader: lz4 block %d is past the image\n", i);
+            return FALSE;
+        }
+
+        data = (const void *)((uint64_t)lz4 + block->data_offset);
+        if (block->comp_size == block->raw_size) {
+            if (hash)
+                sha256_update_copy(hash, (void *)(dest + offset), data,
+                        block->raw_size);
+            else
+                memcpy_stream((void *)(dest + offset), data, block->raw_size);
+        } else if (lz4_decompress_block((const uint8_t *)data,
+                    block->comp_size, (uint8_t *)(dest + offset),
+                    block->raw_size) != block->raw_size) {
+            printf("trusty loader: lz4 block %d is corrupted\n", i);
+            return FALSE;
+        } else if (hash) {
+            sha256_update(hash, (const void *)(dest + offset),
+                    block->raw_size);
+        }
+
+        covered += block->raw_size;
+    }
+
+    if (covered != filesz) {
+        printf("trusty loader: lz4 blocks don't cover segment at 0x%lx\n",
+                phdr->p_paddr);
+        return FALSE;
+    }
+
+    info->copied_bytes += filesz;
+    return TRUE;
+}
+
+static boolean_t elf64_load_executable(uint64_t loadtime_addr,
+        uint64_t image_size, const elf_lz4_hdr_t *lz4, uint64_t runtime_addr,
+        uint64_t *runtime_entry, elf_load_info_t *info)
+{
+    sha256_ctx_t  hash;
     elf64_ehdr_t  *ehdr;
     elf64_phdr_t  *phdr;
     elf64_phdr_t  *phdr_dyn = NULL;
     uint8_t       *phdrtab;
     elf64_dyn_t   *dyn_section;
+    elf64_shdr_t  *altinstr;
     uint64_t      low_addr = (uint64_t) ~0;
     uint64_t      max_addr = 0;
     uint64_t      addr;
@@ -132,6 +681,13 @@ static boolean_t elf64_load_executable(uint64_t loadtime_addr, uint64_t runtime_
     uint64_t      offset_0_addr = (uint64_t)~0;
     uint16_t      cnt;
     uint64_t      runtime_size;
+    uint64_t      align = PAGE_4K_SIZE;
+    uint64_t      pad;
+    uint64_t      t;
+#ifdef TRUSTY_XIP
+    boolean_t     allow_remap;
+    boolean_t     owned = FALSE;
+#endif
 
     /* map ELF header to Ehdr */
     ehdr = (elf64_ehdr_t *)loadtime_addr;
@@ -148,6 +704,11 @@ static boolean_t elf64_load_executable(uint64_t loadtime_addr, uint64_t runtime_
         addr = phdr->p_paddr;
         memsz = phdr->p_memsz;
 
+        if (PT_DYNAMIC == phdr->p_type) {
+            phdr_dyn = phdr;
+            continue;
+        }
+
         if (PT_LOAD != phdr->p_type || 0 == phdr->p_memsz) {
             continue;
         }
@@ -159,6 +720,10 @@ static boolean_t elf64_load_executable(uint64_t loadtime_addr, uint64_t runtime_
         if (addr + memsz > max_addr) {
             max_addr = addr + memsz;
         }
+
+        /* p_align is 0, 1 or a power of 2 */
+        if ((phdr->p_align > align) && !(phdr->p_align & (phdr->p_align - 1)))
+            align = MIN(phdr->p_align, ELF_MAX_SEGMENT_ALIGN);
     }
 
     /* check the memory size */
@@ -169,22 +734,44 @@ static boolean_t elf64_load_executable(uint64_t loadtime_addr, uint64_t runtime_
 
     runtime_size = PAGE_ALIGN_4K(max_addr - low_addr);
 
-    if (TRUSTY_RUNTIME_TOTAL_SIZE < runtime_size || 0 == runtime_size) {
+    /* move the image up until every segment is as aligned at runtime as
+     * it was linked, so trusty and the EPT can map it with 2M pages */
+    pad = (low_addr - runtime_addr) & (align - 1);
+
+    if (TRUSTY_RUNTIME_TOTAL_SIZE - pad < runtime_size || 0 == runtime_size) {
         printf("trusty loader: memory is smaller than required or it is zero\n");
         return FALSE;
     }
 
+    runtime_addr += pad;
+    info->load_base = runtime_addr;
+    info->load_size = runtime_size;
     relocation_offset = runtime_addr - low_addr;
 
+    printf("trusty loader: image at 0x%lx, segments aligned to 0x%lx\n",
+            runtime_addr, align);
+
+    altinstr = elf64_find_section(loadtime_addr,
+            lz4 ? lz4->prefix_size : (uint64_t)~0, ALT_INSTR_SECTION);
+
+#ifdef TRUSTY_XIP
+    /* a compressed image has no pages that could be mapped, and patched
+     * text must not end up in the package pages */
+    allow_remap = (NULL == lz4) && (NULL == altinstr) &&
+        ((NULL == phdr_dyn) || !elf64_has_textrel(
+            (elf64_dyn_t *)(loadtime_addr + phdr_dyn->p_offset),
+            phdr_dyn->p_filesz));
+#endif
+
+    if (info->expected_digest) {
+        sha256_init(&hash);
+        elf64_measure_headers(&hash, ehdr, phdrtab);
+    }
+
     /* now actually copy image to its target destination */
     for (cnt = 0; cnt < (uint16_t)ehdr->e_phnum; ++cnt) {
         phdr = (elf64_phdr_t *)GET_PHDR(ehdr, phdrtab, cnt);
 
-        if (PT_DYNAMIC == phdr->p_type) {
-            phdr_dyn = phdr;
-            continue;
-        }
-
         if (PT_LOAD != phdr->p_type || 0 == phdr->p_memsz) {
             continue;
         }
@@ -201,16 +788,62 @@ static boolean_t elf64_load_executable(uint64_t loadtime_addr, uint64_t runtime_
             filesz = memsz;
         }
 
-        memcpy((void *)(uint64_t)(addr + relocation_offset),
-                (void *)(uint64_t)(loadtime_addr + phdr->p_offset),
-                (uint64_t)filesz);
+        /* an LZ4 image has its blocks checked as they are read */
+        if ((NULL == lz4) && ((phdr->p_offset > image_size) ||
+                    (filesz > image_size - phdr->p_offset))) {
+            printf("trusty loader: segment at 0x%lx is past the image\n",
+                    phdr->p_paddr);
+            return FALSE;
+        }
+
+        elf_record_segment(info, addr + relocation_offset, memsz,
+                phdr->p_flags);
+
+#ifdef TRUSTY_XIP
+        if (allow_remap && elf64_segment_can_remap(ehdr, phdrtab, phdr,
+                    loadtime_addr, relocation_offset) &&
+                elf64_remap_segment(loadtime_addr + phdr->p_offset,
+                    addr + relocation_offset, filesz, &owned)) {
+            /* a measurement of pages the normal world can still write
+             * vouches for nothing, and they are mapped already */
+            if (info->expected_digest && !owned) {
+                printf("trusty loader: segment at 0x%lx mapped in place but "
+                        "not taken from the normal world\n", phdr->p_paddr);
+                return FALSE;
+            }
+            info->remapped_bytes += filesz;
+            if (info->expected_digest) {
+                sha256_update(&hash, (const void *)(addr + relocation_offset),
+                        filesz);
+                elf64_measure_bss(&hash, memsz - filesz);
+            }
+            continue;
+        }
+#endif
+
+        t = rdtsc();
+        if (!elf64_load_segment(loadtime_addr, image_size, lz4, phdr, filesz,
+                    addr + relocation_offset,
+                    info->expected_digest ? &hash : NULL, info))
+            return FALSE;
+        if (info->expected_digest)
+            elf64_measure_bss(&hash, memsz - filesz);
+        t = timeline_add(TL_COPY, t, filesz);
 
         if (filesz < memsz) {
-            memset((void *)(uint64_t)(addr + filesz + relocation_offset), 0,
-                    (uint64_t)(memsz - filesz));
+            elf64_clear_bss(addr + filesz + relocation_offset,
+                    memsz - filesz, info);
+            timeline_add(TL_ZERO, t, memsz - filesz);
         }
     }
 
+    /* nothing of the image has been patched or run yet */
+    t = rdtsc();
+    if (info->expected_digest &&
+            !elf_check_digest(&hash, info->expected_digest, "elf image"))
+        return FALSE;
+    t = timeline_add(TL_VALIDATE, t, 0);
+
     /* if there's a segment whose P_Offset is 0, elf header and
      * segment headers are in this segment and will be relocated
      * to target location with this segment. if such segment exists,
@@ -226,38 +859,215 @@ static boolean_t elf64_load_executable(uint64_t loadtime_addr, uint64_t runtime_
         elf64_update_segment_table(runtime_addr, relocation_offset);
     }
 
+    /* the table holds self-relative offsets only, it can be applied
+     * before relocation */
+    if ((NULL != altinstr) && !elf_apply_alternatives(
+                altinstr->sh_addr + relocation_offset, altinstr->sh_size,
+                runtime_addr, runtime_size))
+        return FALSE;
+
     if (NULL != phdr_dyn) {
-        dyn_section = (elf64_dyn_t *)(loadtime_addr + phdr_dyn->p_offset);
+        /* read it from the loaded image, the package may be compressed */
+        dyn_section = (elf64_dyn_t *)(phdr_dyn->p_paddr + relocation_offset);
         if (!elf64_update_rela_section(ehdr->e_type, relocation_offset, dyn_section,
-                phdr_dyn->p_filesz))
+                phdr_dyn->p_filesz)) {
             printf("trusty loader: failed to update rela section!\n");
-        return FALSE;
+            return FALSE;
+        }
     }
 
+    timeline_add(TL_RELOCATE, t, phdr_dyn ? phdr_dyn->p_filesz : 0);
+
     /* get the relocation entry addr */
     *runtime_entry = ehdr->e_entry + relocation_offset;
 
     return TRUE;
 }
 
+/* the snapshot data starts with the elf and program headers when the
+ * first segment maps them, prelink.py already patched them for base.
+ */
+static void elf_snapshot_segments(uint64_t base, uint64_t data_size,
+        elf_load_info_t *info)
+{
+    elf64_ehdr_t *ehdr = (elf64_ehdr_t *)base;
+    elf64_phdr_t *phdr;
+    uint8_t *phdrtab;
+    uint16_t cnt;
+
+    if ((data_size < sizeof(elf64_ehdr_t)) || !elf_header_is_valid(ehdr) ||
+            (ehdr->e_phoff + (uint64_t)ehdr->e_phnum * ehdr->e_phentsize >
+                data_size))
+        return;
+
+    phdrtab = (uint8_t *)(base + ehdr->e_phoff);
+    for (cnt = 0; cnt < ehdr->e_phnum; ++cnt) {
+        phdr = (elf64_phdr_t *)GET_PHDR(ehdr, phdrtab, cnt);
+        if (PT_LOAD == phdr->p_type && 0 != phdr->p_memsz)
+            elf_record_segment(info, phdr->p_paddr, phdr->p_memsz,
+                    phdr->p_flags);
+    }
+}
+
+/* a snapshot prelinked for runtime_addr is a single copy, anything else
+ * goes through the elf image stored behind it.
+ */
+static boolean_t elf_load_snapshot(uint64_t loadtime_addr,
+        uint64_t image_size, uint64_t runtime_addr, uint64_t *run_entry,
+        elf_load_info_t *info)
+{
+    const elf_snapshot_hdr_t *snap = (const elf_snapshot_hdr_t *)loadtime_addr;
+    sha256_ctx_t hash;
+    uint64_t pad;
+    uint64_t t = rdtsc();
+
+    /* the header carries the digests of everything else */
+    if (info->expected_digest) {
+        sha256_init(&hash);
+        sha256_update(&hash, snap, sizeof(*snap));
+        if (!elf_check_digest(&hash, info->expected_digest, "snapshot header"))
+            return FALSE;
+    }
+    t = timeline_add(TL_VALIDATE, t, sizeof(*snap));
+
+    if (ELF_SNAP_VERSION != snap->version) {
+        printf("trusty loader: snapshot version %d unsupported\n",
+                snap->version);
+        return FALSE;
+    }
+
+    /* prelink.py placed it by the same p_align rule as the elf path */
+    if ((snap->base < runtime_addr) ||
+            (snap->base - runtime_addr >= ELF_MAX_SEGMENT_ALIGN) ||
+            (snap->base & PAGE_4K_MASK)) {
+        if ((0 == snap->elf_offset) || (snap->elf_offset >= image_size)) {
+            printf("trusty loader: snapshot is for 0x%lx, no elf image\n",
+                    snap->base);
+            return FALSE;
+        }
+
+        printf("trusty loader: snapshot is for 0x%lx, loading elf image\n",
+                snap->base);
+        if (info->expected_digest)
+            info->expected_digest = snap->elf_digest;
+        return relocate_elf_image(loadtime_addr + snap->elf_offset,
+                image_size - snap->elf_offset, runtime_addr, run_entry, info);
+    }
+
+    pad = snap->base - runtime_addr;
+    if ((snap->data_offset > image_size) ||
+            (snap->data_size > image_size - snap->data_offset) ||
+            (snap->data_size > TRUSTY_RUNTIME_TOTAL_SIZE - pad) ||
+            (snap->bss_size > TRUSTY_RUNTIME_TOTAL_SIZE - pad -
+                snap->data_size) ||
+            (snap->entry_offset >= snap->data_size)) {
+        printf("trusty loader: snapshot size is invalid\n");
+        return FALSE;
+    }
+
+    runtime_addr = snap->base;
+    info->load_base = runtime_addr;
+    info->load_size = snap->data_size + snap->bss_size;
+
+    if (info->expected_digest) {
+        sha256_init(&hash);
+        sha256_update_copy(&hash, (void *)runtime_addr,
+                (const void *)(loadtime_addr + snap->data_offset),
+                snap->data_size);
+        if (!elf_check_digest(&hash, snap->data_digest, "snapshot"))
+            return FALSE;
+    } else {
+        memcpy_stream((void *)runtime_addr,
+                (const void *)(loadtime_addr + snap->data_offset),
+                snap->data_size);
+    }
+    info->copied_bytes += snap->data_size;
+    t = timeline_add(TL_COPY, t, snap->data_size);
+
+    if (0 != snap->bss_size) {
+        elf64_clear_bss(runtime_addr + snap->data_size, snap->bss_size, info);
+        t = timeline_add(TL_ZERO, t, snap->bss_size);
+    }
+
+    if ((0 != snap->alt_size) && !elf_apply_alternatives(
+                runtime_addr + snap->alt_offset, snap->alt_size, runtime_addr,
+                snap->data_size))
+        return FALSE;
+    timeline_add(TL_RELOCATE, t, snap->alt_size);
+
+    elf_snapshot_segments(runtime_addr, snap->data_size, info);
+
+    *run_entry = runtime_addr + snap->entry_offset;
+
+    return TRUE;
+}
+
 // relocate elf image accroding to header.
-boolean_t relocate_elf_image (uint64_t loadtime_addr,
-        uint64_t runtime_addr, uint64_t *run_entry)
+boolean_t relocate_elf_image (uint64_t loadtime_addr, uint64_t image_size,
+        uint64_t runtime_addr, uint64_t *run_entry, elf_load_info_t *info)
 {
+    elf_load_info_t local_info;
+    elf_lz4_hdr_t *lz4 = NULL;
+    elf64_ehdr_t *ehdr;
+
+    if (!info) {
+        memset(&local_info, 0, sizeof(local_info));
+        info = &local_info;
+    }
+
+    info->load_base = runtime_addr;
+    info->load_size = 0;
+    info->segment_count = 0;
+    info->copied_bytes = 0;
+    info->remapped_bytes = 0;
+    info->zeroed_bytes = 0;
+    info->zero_skipped_bytes = 0;
+
+    if (ELF_SNAP_MAGIC == *(uint32_t *)loadtime_addr)
+        return elf_load_snapshot(loadtime_addr, image_size, runtime_addr,
+                run_entry, info);
+
+    // LZ4 image: headers are uncompressed, segment data is not
+    if (ELF_LZ4_MAGIC == *(uint32_t *)loadtime_addr) {
+        lz4 = (elf_lz4_hdr_t *)loadtime_addr;
+        if (ELF_LZ4_VERSION != lz4->version) {
+            printf("trusty loader: lz4 image version %d unsupported\n",
+                    lz4->version);
+            return FALSE;
+        }
+        if ((image_size < sizeof(*lz4) +
+                    (uint64_t)lz4->block_count * sizeof(elf_lz4_block_t)) ||
+                (lz4->prefix_offset > image_size) ||
+                (lz4->prefix_size > image_size - lz4->prefix_offset)) {
+            printf("trusty loader: lz4 image is truncated\n");
+            return FALSE;
+        }
+        loadtime_addr += lz4->prefix_offset;
+    }
+
+    ehdr = (elf64_ehdr_t *)loadtime_addr;
+
     // check header
-    if (!elf_header_is_valid((elf64_ehdr_t *)loadtime_addr)) {
+    if (!elf_header_is_valid(ehdr)) {
         printf("trusty loader: elf header invalid\n");
         return FALSE;
     }
 
     // check ELF type, 64 bit supports only
-    if (!is_elf64((elf64_ehdr_t *)loadtime_addr)) {
+    if (!is_elf64(ehdr)) {
         printf("trusty loader: elf type unsupported!\n");
         return FALSE;
     }
 
+    if (lz4 && (ehdr->e_phoff + (uint64_t)ehdr->e_phnum * ehdr->e_phentsize >
+                lz4->prefix_size)) {
+        printf("trusty loader: lz4 image lacks program headers\n");
+        return FALSE;
+    }
+
     // load elf image to reserved memory region
-    if (!elf64_load_executable(loadtime_addr, runtime_addr, run_entry)) {
+    if (!elf64_load_executable(loadtime_addr, image_size, lz4, runtime_addr,
+                run_entry, info)) {
         printf("trusty loader: faile to load elf image!\n");
         return FALSE;
     }
@@ -18,6 +18,7 @@
 #define _ELF_LD_H_
 
 #include "trusty_loader_base.h"
+#include "sha256.h"
 
 #define EI_NIDENT       16      /* Size of e_ident array. */
 
@@ -78,6 +79,11 @@
 #define PT_SHLIB        5               /* reserved (not used). */
 #define PT_PHDR         6               /* Location of program header itself. */
 
+/* Values for p_flags. */
+#define PF_X            0x1             /* Executable. */
+#define PF_W            0x2             /* Writable. */
+#define PF_R            0x4             /* Readable. */
+
 /* Values for d_tag. */
 #define DT_NULL         0       /* Terminating entry. */
 #define DT_NEEDED       1       /* String table offset of a needed shared library. */
@@ -111,6 +117,12 @@
 #define DT_RUNPATH      29      /* String table offset of a null-terminated library search path string. */
 #define DT_FLAGS        30      /* Object specific flag values. */
 #define DT_ENCODING     32      /* Values greater than or equal to DT_ENCODING */
+#define DT_RELRSZ       35      /* Total size of ElfNN_Relr relocations. */
+#define DT_RELR         36      /* Address of ElfNN_Relr relocations. */
+#define DT_RELRENT      37      /* Size of each ElfNN_Relr relocation entry. */
+
+/* Values for DT_FLAGS. */
+#define DF_TEXTREL      0x4     /* Relocations may modify a non-writable segment. */
 
 /*
  * 64-bit relocations
@@ -142,6 +154,16 @@
 #define R_X86_64_TPOFF32        23      /* Offset in static TLS block */
 #define R_X86_64_IRELATIVE      37
 
+/* Special section indexes and symbol binding. */
+#define SHN_UNDEF       0               /* Undefined, missing, irrelevant. */
+#define SHN_ABS         0xfff1          /* Absolute values. */
+
+#define STB_LOCAL       0               /* Local symbol */
+#define STB_GLOBAL      1               /* Global symbol */
+#define STB_WEAK        2               /* like global - lower precedence */
+
+#define ELF64_ST_BIND(info)     ((info) >> 4)
+
 /* Legal values for machine_type below */
 
 #define EM_386       3                  /* Intel 80386 */
@@ -167,7 +189,13 @@
 		ELFCLASS64 == (ehdr)->e_ident[EI_CLASS] && \
 		EM_X86_64 == (ehdr)->e_machine)
 
+/* the host harness (tools/host_elf.c) raises it for its larger images */
+#ifndef TRUSTY_RUNTIME_TOTAL_SIZE
 #define TRUSTY_RUNTIME_TOTAL_SIZE   16 MEGABYTE
+#endif
+
+/* p_align is honoured up to this, larger alignments are treated as 2M */
+#define ELF_MAX_SEGMENT_ALIGN       PAGE_2M_SIZE
 
 /*
  * ELF header.
@@ -190,6 +218,23 @@ typedef struct {
 	uint16_t	e_shstrndx;             /* Section name strings section. */
 } elf64_ehdr_t;
 
+/*
+ * Section header.
+ */
+
+typedef struct {
+	uint32_t	sh_name;                /* Section name (index into the section header string table). */
+	uint32_t	sh_type;                /* Section type. */
+	uint64_t	sh_flags;               /* Section flags. */
+	uint64_t	sh_addr;                /* Address in memory image. */
+	uint64_t	sh_offset;              /* Offset in file. */
+	uint64_t	sh_size;                /* Size in bytes. */
+	uint32_t	sh_link;                /* Index of a related section. */
+	uint32_t	sh_info;                /* Depends on section type. */
+	uint64_t	sh_addralign;           /* Alignment in bytes. */
+	uint64_t	sh_entsize;             /* Size of each entry in section. */
+} elf64_shdr_t;
+
 /*
  * Program header.
  */
@@ -224,6 +269,13 @@ typedef struct {
 	uint64_t	r_addend;               /* Addend. */
 } elf64_rela_t;
 
+/* Packed relative relocations (DT_RELR). An even entry is the address of
+ * the next word to relocate, an odd entry is a bitmap: bit n (n >= 1) set
+ * means the n-1th word after the last address is relocated as well. Each
+ * bitmap covers 63 words, the next bitmap continues where it stopped.
+ */
+typedef uint64_t elf64_relr_t;
+
 /*
  * Symbol table entries.
  */
@@ -237,7 +289,109 @@ typedef struct {
 	uint64_t	st_size;        /* Size of associated object. */
 } elf64_sym_t;
 
-boolean_t relocate_elf_image (uint64_t loadtime_addr, uint64_t runtime_addr,
-        uint64_t *run_entry);
+/*
+ * LZ4 compressed image, see tools/lz4pack.py. The ELF header and program
+ * headers are kept uncompressed at prefix_offset, the file contents of the
+ * PT_LOAD segments follow as independent LZ4 blocks which never straddle a
+ * segment, so each one can be decompressed straight to its runtime address.
+ */
+#define ELF_LZ4_MAGIC   0x345a4c54      /* "TLZ4" */
+#define ELF_LZ4_VERSION 1
+
+typedef struct {
+	uint32_t	magic;                  /* ELF_LZ4_MAGIC */
+	uint32_t	version;                /* ELF_LZ4_VERSION */
+	uint32_t	block_count;            /* entries in the block table that follows */
+	uint32_t	reserved;
+	uint64_t	prefix_offset;          /* uncompressed ELF and program headers */
+	uint64_t	prefix_size;
+} elf_lz4_hdr_t;
+
+typedef struct {
+	uint64_t	file_offset;            /* where the block belongs in the ELF file */
+	uint64_t	data_offset;            /* block data, from the start of the image */
+	uint32_t	raw_size;
+	uint32_t	comp_size;              /* equal to raw_size: stored uncompressed */
+} elf_lz4_block_t;
+
+/*
+ * Runtime snapshot, see tools/prelink.py. The image was loaded and
+ * relocated for base at build time: data_size bytes go to base as they
+ * are, bss_size zero bytes follow, then the alternatives table is applied
+ * for the running CPU. When the loader runs with another base it loads the
+ * image at elf_offset instead (an ELF file or LZ4 image).
+ */
+#define ELF_SNAP_MAGIC   0x504e5354     /* "TSNP" */
+#define ELF_SNAP_VERSION 3
+
+typedef struct {
+	uint32_t	magic;                  /* ELF_SNAP_MAGIC */
+	uint32_t	version;                /* ELF_SNAP_VERSION */
+	uint64_t	base;                   /* runtime address it was prelinked for */
+	uint64_t	data_offset;            /* from the start of the image */
+	uint64_t	data_size;
+	uint64_t	bss_size;
+	uint64_t	entry_offset;           /* entry point, relative to base */
+	uint64_t	elf_offset;             /* fallback image, 0 if none */
+	uint64_t	elf_size;
+	uint64_t	alt_offset;             /* alternatives table, relative to base */
+	uint64_t	alt_size;               /* 0 if none */
+	uint8_t		data_digest[SHA256_DIGEST_SIZE];        /* SHA-256 of the data */
+	uint8_t		elf_digest[SHA256_DIGEST_SIZE];         /* measurement of the fallback */
+} elf_snapshot_hdr_t;
+
+/* one loaded segment, passed on to trusty in its boot parameters */
+#define ELF_MAX_LOAD_SEGMENTS       8
+
+/* flags: PF_X/PF_W/PF_R of the segment, plus */
+#define ELF_SEG_LARGE_PAGE          0x100   /* covers at least one whole 2M page */
+
+typedef struct {
+	uint64_t	base;                   /* runtime address, 4K aligned */
+	uint64_t	size;                   /* multiple of 4K */
+	uint32_t	flags;
+	uint32_t	reserved;
+} elf_segment_info_t;
+
+/* optional inputs of relocate_elf_image() and what it did with the image */
+typedef struct {
+	/* in: memory already known to be zero-filled, size 0 if none */
+	uint64_t	zeroed_base;
+	uint64_t	zeroed_size;
+
+	/* in: measurement the image must match, NULL to load it unmeasured */
+	const uint8_t	*expected_digest;
+
+	/* out: where the image went. load_base is runtime_addr moved up so
+	 * the segments keep their p_align, up to ELF_MAX_SEGMENT_ALIGN, and
+	 * load_size runs from there to the end of the bss. at most
+	 * ELF_MAX_LOAD_SEGMENTS segments are listed */
+	uint64_t	load_base;
+	uint64_t	load_size;
+	uint32_t	segment_count;
+	uint32_t	reserved;
+	elf_segment_info_t segments[ELF_MAX_LOAD_SEGMENTS];
+
+	/* out: per-boot statistics */
+	uint64_t	copied_bytes;
+	uint64_t	remapped_bytes;
+	uint64_t	zeroed_bytes;
+	uint64_t	zero_skipped_bytes;
+} elf_load_info_t;
+
+/* loadtime_addr points to an ELF file, an LZ4 image or a runtime
+ * snapshot of image_size bytes, info may be NULL. runtime_addr is the
+ * lowest address the image may be placed at, the image and any padding
+ * must fit in TRUSTY_RUNTIME_TOTAL_SIZE from there.
+ *
+ * The measurement of an ELF or LZ4 image is the SHA-256 of its ELF header
+ * with the section header fields cleared, its program headers and, for
+ * each PT_LOAD segment in program header order, its file contents and the
+ * size of its zero fill, see tools/measure.py. It is checked after loading, before any of the image
+ * runs. A snapshot is measured by its header, which carries the digests
+ * of its data and of its fallback image.
+ */
+boolean_t relocate_elf_image (uint64_t loadtime_addr, uint64_t image_size,
+        uint64_t runtime_addr, uint64_t *run_entry, elf_load_info_t *info);
 
 #endif
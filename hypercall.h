@@ -0,0 +1,70 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef _HYPERCALL_H_
+#define _HYPERCALL_H_
+
+#include "trusty_loader_base.h"
+
+//Macro must align to definition in acorn
+#define _HC_ID(x, y) (((x)<<24)|(y))
+
+#define HC_ID 0x80UL
+
+#define HC_ID_TRUSTY_BASE           0x70UL
+#define HC_INITIALIZE_TRUSTY        _HC_ID(HC_ID, HC_ID_TRUSTY_BASE + 0x00UL)
+
+/* map package pages into the trusty runtime region instead of copying
+ * them, see trusty_remap_param_t. not part of upstream acrn yet, the
+ * loader only issues it when built with TRUSTY_XIP and falls back to a
+ * copy when the hypervisor rejects it. trusty runs the pages in place, so
+ * the hypervisor has to take them from the normal world's EPT as well.
+ */
+#define HC_REMAP_TRUSTY_PAGES       _HC_ID(HC_ID, HC_ID_TRUSTY_BASE + 0x03UL)
+
+/*
+ * Trusty remap params, used for HC_REMAP_TRUSTY_PAGES.
+ */
+typedef struct {
+	uint64_t src_gpa;           /* page aligned source, in the package */
+	uint64_t dst_gpa;           /* page aligned target, in trusty memory */
+	uint64_t size;              /* size in bytes, multiple of 4K */
+	uint32_t flags;             /* TRUSTY_REMAP_* */
+	uint32_t reserved;
+} trusty_remap_param_t;
+
+/* in: the source pages are to be taken from the normal world. out: they
+ * were, the normal world can no longer change what trusty runs. without
+ * it a segment could change after the loader measured it */
+#define TRUSTY_REMAP_EXCLUSIVE      0x1
+#define TRUSTY_REMAP_OWNED          0x2
+
+/* acrn hypercall ABI: id in r8, parameter in rdi, result in rax */
+static inline uint64_t hypercall1(uint64_t id, uint64_t param)
+{
+	uint64_t ret;
+	register uint64_t hypercall_id __asm__("r8") = id;
+
+	__asm__ __volatile__ (
+		"vmcall;"
+		: "=a" (ret)
+		: "r" (hypercall_id), "D" (param)
+		: "memory");
+
+	return ret;
+}
+
+#endif
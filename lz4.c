@@ -0,0 +1,117 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+/*
+ * LZ4 block format decoder, see
+ * https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+ */
+#include "lz4.h"
+#include "util.h"
+
+#define LZ4_MIN_MATCH       4
+
+/* literal and match lengths of 15 continue in the following bytes */
+static boolean_t lz4_read_length(const uint8_t **ip, const uint8_t *iend,
+		uint64_t *length)
+{
+	uint8_t b;
+
+	if (*length != 15)
+		return TRUE;
+
+	do {
+		if (*ip >= iend)
+			return FALSE;
+		b = *(*ip)++;
+		*length += b;
+	} while (b == 255);
+
+	return TRUE;
+}
+
+/* the match source may overlap the destination (offset < length), which
+ * repeats the last "offset" bytes. copy 8 bytes at a time only when the
+ * source is at least that far behind.
+ */
+static void lz4_copy_match(uint8_t *op, const uint8_t *match, uint64_t length)
+{
+	if ((uint64_t)(op - match) >= 8) {
+		while (length >= 8) {
+			*(uint64_t *)op = *(const uint64_t *)match;
+			op += 8;
+			match += 8;
+			length -= 8;
+		}
+	}
+
+	while (length--)
+		*op++ = *match++;
+}
+
+uint64_t lz4_decompress_block(const uint8_t *src, uint64_t src_size,
+		uint8_t *dst, uint64_t dst_size)
+{
+	const uint8_t *ip = src;
+	const uint8_t *iend = src + src_size;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + dst_size;
+	uint64_t length;
+	uint64_t offset;
+	uint8_t token;
+
+	if (!src || !dst)
+		return LZ4_DECOMPRESS_ERROR;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		/* literals */
+		length = token >> 4;
+		if (!lz4_read_length(&ip, iend, &length))
+			return LZ4_DECOMPRESS_ERROR;
+
+		if ((length > (uint64_t)(iend - ip)) ||
+			(length > (uint64_t)(oend - op)))
+			return LZ4_DECOMPRESS_ERROR;
+
+		memcpy(op, ip, length);
+		op += length;
+		ip += length;
+
+		/* the last sequence has literals only */
+		if (ip == iend)
+			break;
+
+		/* match */
+		if (iend - ip < 2)
+			return LZ4_DECOMPRESS_ERROR;
+		offset = ip[0] | ((uint64_t)ip[1] << 8);
+		ip += 2;
+
+		length = token & 0xF;
+		if (!lz4_read_length(&ip, iend, &length))
+			return LZ4_DECOMPRESS_ERROR;
+		length += LZ4_MIN_MATCH;
+
+		if ((offset == 0) || (offset > (uint64_t)(op - dst)) ||
+			(length > (uint64_t)(oend - op)))
+			return LZ4_DECOMPRESS_ERROR;
+
+		lz4_copy_match(op, op - offset, length);
+		op += length;
+	}
+
+	return (uint64_t)(op - dst);
+}
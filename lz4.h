@@ -0,0 +1,31 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef _LZ4_H_
+#define _LZ4_H_
+
+#include "trusty_loader_base.h"
+
+#define LZ4_DECOMPRESS_ERROR    ((uint64_t)-1)
+
+/* decompress one raw LZ4 block (no frame header) of src_size bytes into
+ * dst, which is dst_size bytes large. returns the number of bytes written,
+ * or LZ4_DECOMPRESS_ERROR for malformed input or not enough room in dst.
+ */
+uint64_t lz4_decompress_block(const uint8_t *src, uint64_t src_size,
+		uint8_t *dst, uint64_t dst_size);
+
+#endif
@@ -0,0 +1,74 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+#include "package.h"
+#include "print.h"
+
+static boolean_t pkg_name_equal(const char *entry, const char *name)
+{
+	uint32_t i;
+
+	for (i = 0; i < TRUSTY_PKG_NAME_SIZE; ++i) {
+		if (entry[i] != name[i])
+			return FALSE;
+		if ('\0' == name[i])
+			return TRUE;
+	}
+
+	return '\0' == name[i];
+}
+
+boolean_t package_find(uint64_t base, uint64_t max_size, const char *name,
+		const trusty_pkg_image_t **image)
+{
+	const trusty_pkg_hdr_t *hdr = (const trusty_pkg_hdr_t *)base;
+	const trusty_pkg_image_t *table;
+	uint32_t i;
+
+	if ((max_size < sizeof(trusty_pkg_hdr_t)) || (TRUSTY_PKG_MAGIC != hdr->magic))
+		return FALSE;
+
+	if (TRUSTY_PKG_VERSION != hdr->version) {
+		printf("trusty loader: package version %d unsupported\n",
+				hdr->version);
+		return FALSE;
+	}
+
+	if ((hdr->size > max_size) || (hdr->header_size > hdr->size) ||
+			(hdr->header_size < sizeof(trusty_pkg_hdr_t) +
+			 (uint64_t)hdr->image_count * sizeof(trusty_pkg_image_t))) {
+		printf("trusty loader: package header invalid\n");
+		return FALSE;
+	}
+
+	table = (const trusty_pkg_image_t *)(base + sizeof(trusty_pkg_hdr_t));
+	for (i = 0; i < hdr->image_count; ++i) {
+		if (!pkg_name_equal(table[i].name, name))
+			continue;
+
+		if ((table[i].offset < hdr->header_size) ||
+				(table[i].offset > hdr->size) ||
+				(table[i].size > hdr->size - table[i].offset)) {
+			printf("trusty loader: package image %s out of bounds\n", name);
+			return FALSE;
+		}
+
+		*image = &table[i];
+		return TRUE;
+	}
+
+	printf("trusty loader: no %s image in the package\n", name);
+	return FALSE;
+}
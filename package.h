@@ -0,0 +1,62 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef _PACKAGE_H_
+#define _PACKAGE_H_
+
+#include "trusty_loader_base.h"
+#include "sha256.h"
+
+/*
+ * Image package, see tools/mkpkg.py. The header and the image table come
+ * first, each image starts at a multiple of align from the start of the
+ * package so the loader reads it page aligned. The package is either the
+ * trusty multiboot module or appended to the loader, trusty_pkg_offset in
+ * trusty_loader_entry.S then says where.
+ */
+#define TRUSTY_PKG_MAGIC        0x474b5054      /* "TPKG" */
+#define TRUSTY_PKG_VERSION      1
+
+#define TRUSTY_PKG_NAME_SIZE    16
+
+/* image flags */
+#define TRUSTY_PKG_MEASURED     0x1     /* digest is the image's measurement */
+
+typedef struct {
+	uint32_t	magic;                  /* TRUSTY_PKG_MAGIC */
+	uint32_t	version;                /* TRUSTY_PKG_VERSION */
+	uint32_t	header_size;            /* this header and the image table */
+	uint32_t	image_count;            /* entries in the image table that follows */
+	uint64_t	size;                   /* the whole package */
+	uint64_t	align;                  /* of each image, a power of 2 */
+} trusty_pkg_hdr_t;
+
+typedef struct {
+	char		name[TRUSTY_PKG_NAME_SIZE];     /* NUL padded */
+	uint64_t	offset;                 /* from the start of the package */
+	uint64_t	size;
+	uint32_t	flags;
+	uint32_t	reserved;
+	uint8_t		digest[SHA256_DIGEST_SIZE];     /* see tools/measure.py */
+} trusty_pkg_image_t;
+
+/* the image called name in the package at base, which may span at most
+ * max_size bytes. FALSE if base holds no valid package or no such image.
+ */
+boolean_t package_find(uint64_t base, uint64_t max_size, const char *name,
+		const trusty_pkg_image_t **image);
+
+#endif
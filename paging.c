@@ -0,0 +1,403 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+#include "paging.h"
+#include "cpu.h"
+#include "print.h"
+
+#define PTE_P                   (1ULL << 0)
+#define PTE_RW                  (1ULL << 1)
+#define PTE_PWT                 (1ULL << 3)
+#define PTE_PCD                 (1ULL << 4)
+#define PTE_PS                  (1ULL << 7)
+#define PTE_PAT_4K              (1ULL << 7)
+#define PTE_PAT_LARGE           (1ULL << 12)
+#define PTE_ADDR_MASK           0x000FFFFFFFFFF000ULL
+
+#define PTE_ENTRIES             512
+#define PDPT_SHIFT              30
+#define PD_SHIFT                21
+
+#define CR4_PGE                 (1ULL << 7)
+#define CR4_LA57                (1ULL << 12)
+
+#define MSR_MTRRCAP             0xFE
+#define MSR_MTRR_PHYSBASE0      0x200
+#define MSR_MTRR_PHYSMASK0      0x201
+#define MSR_IA32_PAT            0x277
+#define MSR_MTRR_DEF_TYPE       0x2FF
+
+#define MTRR_DEF_ENABLE         (1ULL << 11)
+#define MTRR_PHYSMASK_VALID     (1ULL << 11)
+#define MTRR_VAR_MAX            32
+
+#define MEM_UC                  0
+#define MEM_WC                  1
+#define MEM_WT                  4
+#define MEM_WP                  5
+#define MEM_WB                  6
+#define MEM_UC_MINUS            7
+#define MEM_UNKNOWN             0xFF
+
+/* PAT at reset, also what PWT/PCD select on CPUs without PAT */
+#define PAT_POWER_ON            0x0007040600070406ULL
+
+/* the top 512M below 4G holds the local APIC, the IOAPIC, the flash and
+ * the MMIO UART on the platforms trusty runs on. mapped uncached so the
+ * identity map does not depend on the MTRRs covering them.
+ */
+#define PAGING_MMIO_BASE        0xE0000000ULL
+#define PAGING_4G               (4 GIGABYTE)
+
+/* PML4, PDPT, one PD for each of the low 4G, one for the runtime range */
+#define PT_PML4                 0
+#define PT_PDPT                 1
+#define PT_PD_LOW               2
+#define PT_PD_RUNTIME           6
+#define PT_PAGES                7
+
+static uint64_t pt_pages[PT_PAGES][PTE_ENTRIES]
+	__attribute__((aligned(PAGE_4K_SIZE)));
+
+static boolean_t paging_ready;
+static uint64_t loader_cr3;
+static uint64_t saved_cr3;
+
+/* the variable MTRRs, read once: in the guest each rdmsr is a VM exit */
+static struct {
+	uint64_t	def;
+	uint64_t	addr_mask;
+	uint64_t	base[MTRR_VAR_MAX];
+	uint64_t	mask[MTRR_VAR_MAX];
+	uint32_t	count;
+	boolean_t	loaded;
+} mtrrs;
+
+static uint64_t read_cr3(void)
+{
+	uint64_t val;
+
+	__asm__ __volatile__ ("movq %%cr3, %0" : "=r" (val));
+	return val;
+}
+
+static void write_cr3(uint64_t val)
+{
+	__asm__ __volatile__ ("movq %0, %%cr3" :: "r" (val) : "memory");
+}
+
+static uint64_t read_cr4(void)
+{
+	uint64_t val;
+
+	__asm__ __volatile__ ("movq %%cr4, %0" : "=r" (val));
+	return val;
+}
+
+static void write_cr4(uint64_t val)
+{
+	__asm__ __volatile__ ("movq %0, %%cr4" :: "r" (val) : "memory");
+}
+
+static const char *mem_type_name(uint32_t type)
+{
+	switch (type) {
+		case MEM_UC:
+			return "UC";
+		case MEM_WC:
+			return "WC";
+		case MEM_WT:
+			return "WT";
+		case MEM_WP:
+			return "WP";
+		case MEM_WB:
+			return "WB";
+		case MEM_UC_MINUS:
+			return "UC-";
+		default:
+			return "n/a";
+	}
+}
+
+static uint64_t read_pat(void)
+{
+	if (cpu_has_feature(X86_FEATURE_PAT))
+		return rdmsr(MSR_IA32_PAT);
+
+	return PAT_POWER_ON;
+}
+
+/* PAT entry an entry selects, pat_bit is where the PAT bit is at its level */
+static uint32_t pte_pat_index(uint64_t entry, uint64_t pat_bit)
+{
+	return ((entry & PTE_PWT) ? 1 : 0) | ((entry & PTE_PCD) ? 2 : 0) |
+		((entry & pat_bit) ? 4 : 0);
+}
+
+static uint64_t pat_index_bits(uint32_t index, uint64_t pat_bit)
+{
+	return ((index & 1) ? PTE_PWT : 0) | ((index & 2) ? PTE_PCD : 0) |
+		((index & 4) ? pat_bit : 0);
+}
+
+static uint32_t pat_find(uint64_t pat, uint32_t type)
+{
+	uint32_t i;
+
+	for (i = 0; i < 8; ++i) {
+		if (((pat >> (i * 8)) & 7) == type)
+			return i;
+	}
+
+	return MEM_UNKNOWN;
+}
+
+static uint32_t phys_addr_bits(void)
+{
+	uint32_t eax, ebx, ecx, edx;
+
+	cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+	if (eax < 0x80000008)
+		return 36;
+
+	cpuid(0x80000008, 0, &eax, &ebx, &ecx, &edx);
+	return eax & 0xFF;
+}
+
+static void mtrr_load(void)
+{
+	uint32_t i;
+
+	if (mtrrs.loaded)
+		return;
+	mtrrs.loaded = TRUE;
+
+	if (!cpu_has_feature(X86_FEATURE_MTRR))
+		return;
+
+	mtrrs.def = rdmsr(MSR_MTRR_DEF_TYPE);
+	if (!(mtrrs.def & MTRR_DEF_ENABLE))
+		return;
+
+	mtrrs.addr_mask = ((1ULL << phys_addr_bits()) - 1) &
+		~(uint64_t)PAGE_4K_MASK;
+	mtrrs.count = MIN((uint32_t)rdmsr(MSR_MTRRCAP) & 0xFF, MTRR_VAR_MAX);
+
+	for (i = 0; i < mtrrs.count; ++i) {
+		mtrrs.mask[i] = rdmsr(MSR_MTRR_PHYSMASK0 + i * 2);
+		if (mtrrs.mask[i] & MTRR_PHYSMASK_VALID)
+			mtrrs.base[i] = rdmsr(MSR_MTRR_PHYSBASE0 + i * 2);
+	}
+}
+
+/* the variable MTRRs only, the fixed ones cover the first 1M which holds
+ * neither the package nor the runtime range. overlaps resolve the way the
+ * SDM defines: UC wins, WT wins over WB.
+ */
+static uint32_t mtrr_type(uint64_t addr)
+{
+	uint64_t mask;
+	uint32_t i, t;
+	uint32_t type = MEM_UNKNOWN;
+
+	mtrr_load();
+	if (!cpu_has_feature(X86_FEATURE_MTRR))
+		return MEM_UNKNOWN;
+
+	if (!(mtrrs.def & MTRR_DEF_ENABLE))
+		return MEM_UC;
+
+	for (i = 0; i < mtrrs.count; ++i) {
+		if (!(mtrrs.mask[i] & MTRR_PHYSMASK_VALID))
+			continue;
+
+		mask = mtrrs.mask[i] & mtrrs.addr_mask;
+		if ((addr & mask) != (mtrrs.base[i] & mask))
+			continue;
+
+		t = (uint32_t)mtrrs.base[i] & 0xFF;
+		if ((MEM_UNKNOWN == type) || (t == type))
+			type = t;
+		else if ((MEM_UC == t) || (MEM_UC == type))
+			type = MEM_UC;
+		else if ((MEM_WT == t) || (MEM_WT == type))
+			type = MEM_WT;
+	}
+
+	return (MEM_UNKNOWN == type) ? (uint32_t)(mtrrs.def & 0xFF) : type;
+}
+
+/* through a WB PAT entry the memory type is the MTRR type, or WB without
+ * MTRRs. the first page of [base, base + size) that is not WB, if any */
+static boolean_t range_is_wb(uint64_t base, uint64_t size, uint64_t *addr,
+		uint32_t *type)
+{
+	for (*addr = base; *addr < base + size; *addr += PAGE_4K_SIZE) {
+		*type = mtrr_type(*addr);
+		if ((MEM_WB != *type) && (MEM_UNKNOWN != *type))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+void paging_report(const char *name, uint64_t addr)
+{
+	uint64_t *table;
+	uint64_t entry;
+	uint64_t pat_bit = PTE_PAT_4K;
+	uint32_t shift;
+	const char *size;
+
+	if (read_cr4() & CR4_LA57) {
+		printf("trusty loader: %s 0x%lx: 5-level paging, not inspected\n",
+				name, addr);
+		return;
+	}
+
+	/* vSBL identity maps the memory that holds its page tables */
+	table = (uint64_t *)(read_cr3() & PTE_ADDR_MASK);
+	for (shift = 39; ; shift -= 9) {
+		entry = table[(addr >> shift) & (PTE_ENTRIES - 1)];
+		if (!(entry & PTE_P)) {
+			printf("trusty loader: %s 0x%lx: not mapped\n", name, addr);
+			return;
+		}
+
+		if ((shift <= PDPT_SHIFT) && (shift > 12) && (entry & PTE_PS)) {
+			pat_bit = PTE_PAT_LARGE;
+			break;
+		}
+
+		if (12 == shift)
+			break;
+
+		table = (uint64_t *)(entry & PTE_ADDR_MASK);
+	}
+
+	size = (PDPT_SHIFT == shift) ? "1G" : (PD_SHIFT == shift) ? "2M" : "4K";
+
+	printf("trusty loader: %s 0x%lx: %s page, PAT %s, MTRR %s\n", name, addr,
+			size, mem_type_name((uint32_t)(read_pat() >>
+					(pte_pat_index(entry, pat_bit) * 8)) & 7),
+			mem_type_name(mtrr_type(addr)));
+}
+
+/* map the 1G at gb with 2M pages */
+static void map_gb_2m(uint64_t *pdpt, uint64_t gb, uint64_t *pd,
+		uint32_t wb, uint32_t uc)
+{
+	uint64_t addr;
+	uint32_t i;
+
+	for (i = 0; i < PTE_ENTRIES; ++i) {
+		addr = (gb << PDPT_SHIFT) + ((uint64_t)i << PD_SHIFT);
+		pd[i] = addr | PTE_P | PTE_RW | PTE_PS |
+			pat_index_bits(((addr >= PAGING_MMIO_BASE) &&
+						(addr < PAGING_4G)) ? uc : wb, PTE_PAT_LARGE);
+	}
+
+	pdpt[gb] = (uint64_t)pd | PTE_P | PTE_RW;
+}
+
+boolean_t paging_init(uint64_t runtime_base, uint64_t runtime_size)
+{
+	uint64_t *pml4 = pt_pages[PT_PML4];
+	uint64_t *pdpt = pt_pages[PT_PDPT];
+	uint64_t runtime_gb = runtime_base >> PDPT_SHIFT;
+	uint64_t pat = read_pat();
+	uint32_t wb = pat_find(pat, MEM_WB);
+	uint32_t uc = pat_find(pat, MEM_UC);
+	boolean_t gb_pages = cpu_has_feature(X86_FEATURE_PDPE1GB);
+	uint64_t gb, addr;
+	uint32_t type;
+
+	if (read_cr4() & CR4_LA57) {
+		printf("trusty loader: 5-level paging, keeping vSBL page tables\n");
+		return FALSE;
+	}
+
+	if ((MEM_UNKNOWN == wb) || (MEM_UNKNOWN == uc)) {
+		printf("trusty loader: PAT 0x%lx has no WB or UC entry\n", pat);
+		return FALSE;
+	}
+
+	/* a WB PAT entry can't make memory the MTRRs keep from WB write-back,
+	 * the loader's map would be no better than vSBL's */
+	if (!range_is_wb(runtime_base, runtime_size, &addr, &type)) {
+		printf("trusty loader: trusty memory at 0x%lx is %s in the "
+				"MTRRs, not WB, keeping vSBL page tables\n", addr,
+				mem_type_name(type));
+		return FALSE;
+	}
+
+	/* one PDPT covers the first 512G */
+	if ((0 == runtime_size) || (runtime_gb >= PTE_ENTRIES) ||
+			(((runtime_base + runtime_size - 1) >> PDPT_SHIFT) != runtime_gb)) {
+		printf("trusty loader: can't identity map 0x%lx+0x%lx\n",
+				runtime_base, runtime_size);
+		return FALSE;
+	}
+
+	pml4[0] = (uint64_t)pdpt | PTE_P | PTE_RW;
+
+	if (gb_pages) {
+		for (gb = 0; gb < PTE_ENTRIES; ++gb)
+			pdpt[gb] = (gb << PDPT_SHIFT) | PTE_P | PTE_RW | PTE_PS |
+				pat_index_bits(wb, PTE_PAT_LARGE);
+	}
+
+	/* with 1G pages only the 1G holding the MMIO hole is split */
+	for (gb = gb_pages ? 3 : 0; gb < 4; ++gb)
+		map_gb_2m(pdpt, gb, pt_pages[PT_PD_LOW + gb], wb, uc);
+
+	if (!gb_pages && (runtime_gb >= 4))
+		map_gb_2m(pdpt, runtime_gb, pt_pages[PT_PD_RUNTIME], wb, uc);
+
+	loader_cr3 = (uint64_t)pml4;
+	paging_ready = TRUE;
+
+	printf("trusty loader: identity map with %s pages, PAT entry %d is WB\n",
+			gb_pages ? "1G" : "2M", wb);
+	return TRUE;
+}
+
+/* a CR3 write leaves global TLB entries alone, toggling CR4.PGE drops
+ * those vSBL may have left for the ranges the loader is about to use.
+ */
+void paging_enter(void)
+{
+	uint64_t cr4 = read_cr4();
+
+	if (!paging_ready)
+		return;
+
+	saved_cr3 = read_cr3();
+
+	if (cr4 & CR4_PGE)
+		write_cr4(cr4 & ~CR4_PGE);
+	write_cr3(loader_cr3);
+	if (cr4 & CR4_PGE)
+		write_cr4(cr4);
+}
+
+void paging_leave(void)
+{
+	if (0 == saved_cr3)
+		return;
+
+	write_cr3(saved_cr3);
+	saved_cr3 = 0;
+}
@@ -0,0 +1,41 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef _PAGING_H_
+#define _PAGING_H_
+
+#include "trusty_loader_base.h"
+
+/* print how the current page tables and the MTRRs map addr: page size,
+ * PAT type and MTRR type. call cpu_init() first.
+ */
+void paging_report(const char *name, uint64_t addr);
+
+/* build the loader's own identity map: the low 4G and the 1G holding
+ * [runtime_base, runtime_base + runtime_size), with 1G pages when the CPU
+ * has them and 2M pages otherwise. RAM is mapped through a write-back PAT
+ * entry, the top of the 4G hole uncached. FALSE if it can't be built, or
+ * if the MTRRs make part of the runtime range anything but WB, with a
+ * warning; the loader then stays on the page tables it was started with.
+ */
+boolean_t paging_init(uint64_t runtime_base, uint64_t runtime_size);
+
+/* switch CR3 to the identity map and back, paging_init() must have
+ * succeeded */
+void paging_enter(void);
+void paging_leave(void);
+
+#endif
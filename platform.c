@@ -0,0 +1,69 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+#include "platform.h"
+#include "hypercall.h"
+#include "serial.h"
+
+/* TODO: hard code here, will get from PCI driver */
+#define PLATFORM_SERIAL_BASE    0xfc000000
+
+uint64_t platform_hypercall(uint64_t id, uint64_t param)
+{
+	return hypercall1(id, param);
+}
+
+uint32_t platform_console_init(void)
+{
+	serial_init(PLATFORM_SERIAL_BASE);
+	return serial_get_fifo_depth();
+}
+
+void platform_console_write(const char *buf, uint64_t size)
+{
+	serial_write(buf, size, PLATFORM_SERIAL_BASE);
+}
+
+void *platform_mem(uint64_t addr, uint64_t size)
+{
+	(void)size;
+
+	return (void *)addr;
+}
+
+void platform_launch_linux(uint64_t rip, uint64_t rax, uint64_t rbx,
+		uint64_t rsi, uint64_t rdi, uint64_t rcx)
+{
+	__asm__ __volatile__ ("cli\n\t"
+			"movq %1, %%rax\n\t"
+			"movq %2, %%rbx\n\t"
+			"movq %3, %%rsi\n\t"
+			"movq %4, %%rdi\n\t"
+			"movq %5, %%rcx\n\t"
+			"jmp *%0\n\t"
+			:
+			: "m" (rip),
+			"m" (rax),
+			"m" (rbx),
+			"m" (rsi),
+			"m" (rdi),
+			"m" (rcx));
+	__builtin_unreachable();
+}
+
+void platform_halt(void)
+{
+	__STOP_HERE__;
+}
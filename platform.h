@@ -0,0 +1,50 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef _PLATFORM_H_
+#define _PLATFORM_H_
+
+#include "trusty_loader_base.h"
+
+/*
+ * What the loader needs from the machine it boots on. platform.c is the
+ * ACRN guest the loader runs in; tools/host_shim.c implements the same
+ * calls in a Linux process, see tools/host_boot.c.
+ */
+
+/* a hypercall, id and parameter as in hypercall.h, returns the result */
+uint64_t platform_hypercall(uint64_t id, uint64_t param);
+
+/* set the console up, returns its transmit FIFO depth in bytes, 0 if
+ * it is not known */
+uint32_t platform_console_init(void);
+void platform_console_write(const char *buf, uint64_t size);
+
+/* [addr, addr + size) of guest physical memory, NULL if it is not
+ * there. vSBL identity maps all of it, the loader's own paging keeps
+ * the identity map.
+ */
+void *platform_mem(uint64_t addr, uint64_t size);
+
+/* jump to Linux with the registers vSBL asked for, interrupts off */
+void platform_launch_linux(uint64_t rip, uint64_t rax, uint64_t rbx,
+		uint64_t rsi, uint64_t rdi, uint64_t rcx)
+		__attribute__((noreturn));
+
+/* stop for good after a failed boot */
+void platform_halt(void) __attribute__((noreturn));
+
+#endif
@@ -14,22 +14,67 @@
 * limitations under the License.
 *******************************************************************************/
 #include "print.h"
-#include "serial.h"
+#include "platform.h"
 #include "string.h"
+#include "util.h"
 
 #define PRINTF_BUFFER_SIZE 256
 
-static uint64_t serial_base;
+/* .bss, after trusty_loader.bin (linker.lds). print_init() sets the
+ * header up, the data is only read back up to head */
+static log_ring_t log_ring __attribute__((aligned(PAGE_4K_SIZE)));
 
 void print_init(void)
 {
-	/* TODO: hard code here, will get from PCI driver */
-	serial_base = 0xfc000000;
+	uint32_t fifo_depth = platform_console_init();
+
+	log_ring.magic = LOG_RING_MAGIC;
+	log_ring.size = LOG_RING_SIZE;
+	log_ring.head = 0;
+	log_ring.flushed = 0;
+
+	printf("trusty loader: UART FIFO %d bytes\n", fifo_depth);
+}
+
+void print_flush(void)
+{
+	uint64_t start;
+	uint64_t size;
+
+	while (log_ring.flushed != log_ring.head) {
+		start = log_ring.flushed & (LOG_RING_SIZE - 1);
+		size = MIN(log_ring.head - log_ring.flushed, LOG_RING_SIZE - start);
+		platform_console_write(log_ring.data + start, size);
+		log_ring.flushed += size;
+	}
+}
+
+const log_ring_t *print_log_ring(void)
+{
+	return &log_ring;
+}
+
+static void log_append(const char *buf, uint32_t size)
+{
+	uint64_t start = log_ring.head & (LOG_RING_SIZE - 1);
+	uint64_t first = MIN(size, LOG_RING_SIZE - start);
+
+	/* a full ring is sent rather than overwritten */
+	if (log_ring.head + size - log_ring.flushed > LOG_RING_SIZE)
+		print_flush();
+
+	memcpy(log_ring.data + start, buf, first);
+	memcpy(log_ring.data, buf + first, size - first);
+	log_ring.head += size;
+
+#ifdef LOG_SYNC
+	print_flush();
+#endif
 }
 
 /*caller must make sure this function is NOT
 called simultaneously in different cpus*/
-void printf(const char *format, ...)
+void (printf)(const char *format, ...)
 {
 	uint32_t printed_size;
 	/* use static buffer to save stack space */
@@ -40,6 +85,89 @@ void printf(const char *format, ...)
 	printed_size = vmm_vsprintf_s(buffer, PRINTF_BUFFER_SIZE, format, args);
 	va_end(args);
 	if (printed_size > 0)
-		serial_puts(buffer, serial_base);
+		log_append(buffer, printed_size);
+}
+
+#ifdef LOG_TOKENS
+/* start of the .logfmt output section, see linker.lds */
+extern const char __logfmt_start[] __attribute__((visibility("hidden")));
+
+uint32_t log_token_format(const char *format)
+{
+	/* both addresses are RIP relative, the load offset cancels out */
+	return (uint32_t)((uint64_t)format - (uint64_t)__logfmt_start);
+}
+
+uint64_t log_token_word(uint64_t word)
+{
+	return word;
 }
 
+uint64_t log_token_ptr(const void *ptr)
+{
+	return (uint64_t)ptr;
+}
+
+uint64_t log_token_str(const char *str)
+{
+	return (uint64_t)str;
+}
+
+static uint32_t varint(uint8_t *out, uint64_t value)
+{
+	uint32_t len = 0;
+
+	while (value >= 0x80) {
+		out[len++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	out[len++] = (uint8_t)value;
+
+	return len;
+}
+
+void log_token(uint32_t format, uint32_t strings, uint32_t count, ...)
+{
+	uint8_t record[PRINTF_BUFFER_SIZE];
+	const char *str;
+	uint64_t word;
+	uint32_t len = 0;
+	uint32_t room;
+	uint32_t n;
+	uint32_t i;
+	va_list args;
+
+	count = MIN(count, LOG_TOKEN_ARGS);
+	strings &= (1U << count) - 1;
+
+	record[len++] = LOG_TOKEN_SYNC;
+	len += varint(record + len, format);
+	len += varint(record + len, (uint64_t)strings << 4 | count);
+
+	va_start(args, count);
+	for (i = 0; i < count; ++i) {
+		word = va_arg(args, uint64_t);
+		if (!(strings & (1U << i))) {
+			len += varint(record + len, word);
+			continue;
+		}
+
+		/* a string may take what the varints still to come leave, at
+		 * most 10 bytes each */
+		room = sizeof(record) - len - 1 - 10 * (count - i - 1);
+		room = MIN(room, LOG_TOKEN_STR_MAX);
+
+		str = (const char *)word;
+		if (NULL == str)
+			str = "<null string>";
+		for (n = 0; n < room && str[n]; ++n)
+			;
+		len += varint(record + len, n);
+		memcpy(record + len, str, n);
+		len += n;
+	}
+	va_end(args);
+
+	log_append((const char *)record, len);
+}
+#endif
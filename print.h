@@ -19,9 +19,108 @@
 
 #include "trusty_loader_base.h"
 
+/* printf() output is kept in this ring and only sent to the UART by
+ * print_flush(), or when the ring would overwrite what was not sent yet.
+ * it stays in loader memory after the handoff, magic marks it there.
+ */
+#define LOG_RING_MAGIC      0x474f4c54      /* "TLOG" */
+#define LOG_RING_SIZE       (16 KILOBYTE)   /* a power of 2 */
+
+typedef struct {
+	uint32_t magic;                 /* LOG_RING_MAGIC */
+	uint32_t size;                  /* LOG_RING_SIZE */
+	uint64_t head;                  /* bytes ever written, data[head % size] is next */
+	uint64_t flushed;               /* bytes of those sent to the UART */
+	char data[LOG_RING_SIZE];
+} log_ring_t;
+
 /*caller must make sure this function is NOT
 called simultaneously in different cpus*/
 void printf(const char *format, ...);
 void print_init(void);
 
+/* send what the ring holds to the UART, before the handoff or when the
+ * loader gives up */
+void print_flush(void);
+
+/* the ring, for the handoff message */
+const log_ring_t *print_log_ring(void);
+
+#ifdef LOG_TOKENS
+/*
+ * Tokenized printf(): the format string goes to the .logfmt section, which
+ * is not part of trusty_loader.bin, and only its offset there and the raw
+ * arguments are logged. tools/logdecode.py turns that back into text with
+ * the section make saves as trusty_loader.logfmt. A record is
+ *
+ *     LOG_TOKEN_SYNC, varint format offset,
+ *     varint (strings << 4 | count), bit i of strings set for %s arguments,
+ *     then for each argument
+ *     a varint (integers and pointers, sign extended to 64 bit) or
+ *     a varint length and the bytes (char pointers, for %s)
+ *
+ * a varint is LEB128: 7 bits a byte, low bits first, bit 7 set on all but
+ * the last byte. at most LOG_TOKEN_ARGS arguments.
+ */
+#define LOG_TOKEN_SYNC      0x1E    /* ASCII RS, never in the loader's text */
+#define LOG_TOKEN_ARGS      8
+#define LOG_TOKEN_STR_MAX   64      /* longer %s arguments are cut */
+
+uint32_t log_token_format(const char *format);
+uint64_t log_token_word(uint64_t word);
+uint64_t log_token_ptr(const void *ptr);
+uint64_t log_token_str(const char *str);
+void log_token(uint32_t format, uint32_t strings, uint32_t count, ...);
+
+#define LOG_TOKEN_ID(fmt) ({ \
+	static const char log_format_[] \
+		__attribute__((section(".logfmt"), used)) = fmt; \
+	log_token_format(log_format_); })
+
+#define LOG_IS_STR(x) _Generic((x), char *: 1, const char *: 1, default: 0)
+
+#define LOG_ARG(x) _Generic((x), \
+	char *: log_token_str, const char *: log_token_str, \
+	void *: log_token_ptr, const void *: log_token_ptr, \
+	default: log_token_word)(x)
+
+#define LOG_NARGS(...) LOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+
+#define LOG_CAT(a, b) LOG_CAT_(a, b)
+#define LOG_CAT_(a, b) a##b
+
+/* bit i of strings is set if argument i is a string */
+#define LOG_S(i, x) ((uint32_t)LOG_IS_STR(x) << (i))
+#define LOG_STRINGS_0() 0
+#define LOG_STRINGS_1(a) LOG_S(0, a)
+#define LOG_STRINGS_2(a, b) LOG_STRINGS_1(a) | LOG_S(1, b)
+#define LOG_STRINGS_3(a, b, c) LOG_STRINGS_2(a, b) | LOG_S(2, c)
+#define LOG_STRINGS_4(a, b, c, d) LOG_STRINGS_3(a, b, c) | LOG_S(3, d)
+#define LOG_STRINGS_5(a, b, c, d, e) LOG_STRINGS_4(a, b, c, d) | LOG_S(4, e)
+#define LOG_STRINGS_6(a, b, c, d, e, f) \
+	LOG_STRINGS_5(a, b, c, d, e) | LOG_S(5, f)
+#define LOG_STRINGS_7(a, b, c, d, e, f, g) \
+	LOG_STRINGS_6(a, b, c, d, e, f) | LOG_S(6, g)
+#define LOG_STRINGS_8(a, b, c, d, e, f, g, h) \
+	LOG_STRINGS_7(a, b, c, d, e, f, g) | LOG_S(7, h)
+
+#define LOG_ARGS_0()
+#define LOG_ARGS_1(a) , LOG_ARG(a)
+#define LOG_ARGS_2(a, b) LOG_ARGS_1(a), LOG_ARG(b)
+#define LOG_ARGS_3(a, b, c) LOG_ARGS_2(a, b), LOG_ARG(c)
+#define LOG_ARGS_4(a, b, c, d) LOG_ARGS_3(a, b, c), LOG_ARG(d)
+#define LOG_ARGS_5(a, b, c, d, e) LOG_ARGS_4(a, b, c, d), LOG_ARG(e)
+#define LOG_ARGS_6(a, b, c, d, e, f) LOG_ARGS_5(a, b, c, d, e), LOG_ARG(f)
+#define LOG_ARGS_7(a, b, c, d, e, f, g) \
+	LOG_ARGS_6(a, b, c, d, e, f), LOG_ARG(g)
+#define LOG_ARGS_8(a, b, c, d, e, f, g, h) \
+	LOG_ARGS_7(a, b, c, d, e, f, g), LOG_ARG(h)
+
+#define printf(fmt, ...) log_token(LOG_TOKEN_ID(fmt), \
+	LOG_CAT(LOG_STRINGS_, LOG_NARGS(__VA_ARGS__))(__VA_ARGS__), \
+	LOG_NARGS(__VA_ARGS__) \
+	LOG_CAT(LOG_ARGS_, LOG_NARGS(__VA_ARGS__))(__VA_ARGS__))
+#endif
+
 #endif
@@ -30,6 +30,38 @@
 
 #define UART_LSR_THRE_MASK (1 << 5)
 
+#define UART_LCR_8N1       0x03
+#define UART_LCR_DLAB      (1 << 7)
+
+#define UART_MCR_DTR_RTS   0x03
+
+#define UART_FCR_ENABLE    (1 << 0)
+#define UART_FCR_CLR_RX    (1 << 1)
+#define UART_FCR_CLR_TX    (1 << 2)
+#define UART_FCR_FIFO64    (1 << 5)     /* 16750, needs LCR.DLAB to be set */
+
+#define UART_IIR_FIFO_MASK 0xC0
+#define UART_IIR_FIFO_ON   0xC0
+#define UART_IIR_FIFO64    (1 << 5)
+
+/* DesignWare APB UART component parameters, FIFO_MODE in bits 23:16 is
+ * the FIFO depth / 16, 0 when the register is not implemented */
+#define DW_UART_CPR        0xF4
+#define DW_UART_CPR_FIFO_MODE(cpr) (((cpr) >> 16) & 0xFF)
+
+/* the divisor latch is left as the firmware set it, at the rate Linux
+ * and the console on the other end expect, unless SERIAL_DIVISOR is
+ * defined. 1 is the highest rate the UART clock allows, 115200 on a
+ * 1.8432MHz clock. a latch of 0 stops the clock, 1 is taken then. */
+#define SERIAL_DIVISOR_FALLBACK 1
+
+/* LSR reads before a stuck transmitter is written to anyway */
+#define SERIAL_THRE_SPINS  1000000
+
+/* bytes that can be written back to back once THRE is set, 1 until
+ * serial_init() found the FIFO */
+static uint32_t fifo_depth = 1;
+
 #ifdef SERIAL_MMIO
 static inline uint8_t serial_get_reg(uint64_t base_addr, uint32_t reg)
 {
@@ -72,22 +104,85 @@ static inline void serial_set_reg(uint64_t base_addr, uint32_t reg, uint8_t val)
 }
 #endif
 
-static void serial_putc(char c, uint64_t serial_base)
+static uint32_t serial_fifo_depth(uint64_t serial_base)
+{
+	uint8_t iir = serial_get_reg(serial_base, UART_REG_IIR);
+#ifdef SERIAL_MMIO
+	uint32_t cpr;
+#endif
+
+	if ((iir & UART_IIR_FIFO_MASK) != UART_IIR_FIFO_ON)
+		return 1;
+
+#ifdef SERIAL_MMIO
+	cpr = *(volatile uint32_t *)(serial_base + DW_UART_CPR);
+	if ((DW_UART_CPR_FIFO_MODE(cpr) >= 1) && (DW_UART_CPR_FIFO_MODE(cpr) <= 8))
+		return DW_UART_CPR_FIFO_MODE(cpr) * 16;
+#endif
+
+	return (iir & UART_IIR_FIFO64) ? 64 : 16;
+}
+
+void serial_init(uint64_t serial_base)
+{
+	uint32_t divisor;
+
+	serial_set_reg(serial_base, UART_REG_IER, 0);
+
+	serial_set_reg(serial_base, UART_REG_LCR, UART_LCR_DLAB | UART_LCR_8N1);
+#ifdef SERIAL_DIVISOR
+	divisor = SERIAL_DIVISOR;
+#else
+	divisor = serial_get_reg(serial_base, UART_REG_DLL) |
+		((uint32_t)serial_get_reg(serial_base, UART_REG_DLM) << 8);
+	if (0 == divisor)
+		divisor = SERIAL_DIVISOR_FALLBACK;
+#endif
+	serial_set_reg(serial_base, UART_REG_DLL, (uint8_t)(divisor & 0xFF));
+	serial_set_reg(serial_base, UART_REG_DLM, (uint8_t)((divisor >> 8) & 0xFF));
+	serial_set_reg(serial_base, UART_REG_FCR, UART_FCR_ENABLE |
+			UART_FCR_CLR_RX | UART_FCR_CLR_TX | UART_FCR_FIFO64);
+	serial_set_reg(serial_base, UART_REG_LCR, UART_LCR_8N1);
+
+	serial_set_reg(serial_base, UART_REG_MCR, UART_MCR_DTR_RTS);
+
+	fifo_depth = serial_fifo_depth(serial_base);
+}
+
+uint32_t serial_get_fifo_depth(void)
 {
-	uint8_t data;
+	return fifo_depth;
+}
 
-	while (1)
-	{
-		data = serial_get_reg(serial_base, UART_REG_LSR);
-		if (data & UART_LSR_THRE_MASK)
-			break;
+/* with the FIFO on, THRE means the whole transmit FIFO is empty */
+static void serial_wait_thre(uint64_t serial_base)
+{
+	uint32_t i;
+
+	for (i = 0; i < SERIAL_THRE_SPINS; ++i) {
+		if (serial_get_reg(serial_base, UART_REG_LSR) & UART_LSR_THRE_MASK)
+			return;
+		__asm__ __volatile__ ("pause");
+	}
+}
+
+void serial_write(const char *buf, uint64_t size, uint64_t serial_base)
+{
+	uint64_t i = 0;
+	uint64_t burst;
+
+	while (i < size) {
+		serial_wait_thre(serial_base);
+		for (burst = MIN(size - i, fifo_depth); burst; --burst)
+			serial_set_reg(serial_base, UART_REG_THR, (uint8_t)buf[i++]);
 	}
-	serial_set_reg(serial_base, UART_REG_THR, c);
 }
 
 void serial_puts(const char *str, uint64_t serial_base)
 {
-	uint32_t i;
-	for (i = 0; str[i] != 0; i++)
-		serial_putc(str[i], serial_base);
+	uint64_t len = 0;
+
+	while (str[len] != 0)
+		len++;
+	serial_write(str, len, serial_base);
 }
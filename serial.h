@@ -19,5 +19,15 @@
 
 #include "trusty_loader_base.h"
 uint64_t get_serial_base(void);
+
+/* 8N1 at the firmware's baud rate, or at SERIAL_DIVISOR if it is
+ * defined, interrupts off, FIFOs on and cleared. finds the
+ * transmit FIFO depth, 16 or 64 from IIR or up to 128 from the CPR of a
+ * DesignWare UART, which serial_write() then fills in one burst per THRE
+ * wait.
+ */
+void serial_init(uint64_t serial_base);
+uint32_t serial_get_fifo_depth(void);
 void serial_puts(const char *str, uint64_t serial_base);
+void serial_write(const char *buf, uint64_t size, uint64_t serial_base);
 #endif
@@ -0,0 +1,265 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+#include "sha256.h"
+#include "cpu.h"
+#include "util.h"
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/* the scalar sha256_update_copy() hashes and copies this much at a time,
+ * small enough to still be in L1 for the copy. the copy streams if the
+ * whole range is big enough for memcpy_stream() to */
+#define SHA256_COPY_CHUNK       (4 KILOBYTE)
+
+/* set by sha256_init() */
+static boolean_t use_sha_ni;
+
+#define ROR32(x, n)     (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define S0(x)           (ROR32(x, 2) ^ ROR32(x, 13) ^ ROR32(x, 22))
+#define S1(x)           (ROR32(x, 6) ^ ROR32(x, 11) ^ ROR32(x, 25))
+#define s0(x)           (ROR32(x, 7) ^ ROR32(x, 18) ^ ((x) >> 3))
+#define s1(x)           (ROR32(x, 17) ^ ROR32(x, 19) ^ ((x) >> 10))
+
+#define CH(x, y, z)     ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z)    (((x) & (y)) | ((z) & ((x) | (y))))
+
+/* the message schedule lives in a 16 word ring, W(i) is expanded in place.
+ * eight words can be expanded ahead of the rounds that use them, none of
+ * them depends on a word it overwrites.
+ */
+#define W(i)            w[(i) & 15]
+#define EXPAND(i)       (W(i) += s1(W((i) - 2)) + W((i) - 7) + s0(W((i) - 15)))
+
+/* one round without moving the working variables: the callers rotate the
+ * names instead, eight rounds bring them back where they started. */
+#define ROUND(a, b, c, d, e, f, g, h, i, wi) do { \
+	uint32_t t1 = (h) + S1(e) + CH(e, f, g) + sha256_k[i] + (wi); \
+	(d) += t1; \
+	(h) = t1 + S0(a) + MAJ(a, b, c); \
+} while (0)
+
+#define ROUNDS8(i) do { \
+	ROUND(a, b, c, d, e, f, g, h, (i) + 0, W((i) + 0)); \
+	ROUND(h, a, b, c, d, e, f, g, (i) + 1, W((i) + 1)); \
+	ROUND(g, h, a, b, c, d, e, f, (i) + 2, W((i) + 2)); \
+	ROUND(f, g, h, a, b, c, d, e, (i) + 3, W((i) + 3)); \
+	ROUND(e, f, g, h, a, b, c, d, (i) + 4, W((i) + 4)); \
+	ROUND(d, e, f, g, h, a, b, c, (i) + 5, W((i) + 5)); \
+	ROUND(c, d, e, f, g, h, a, b, (i) + 6, W((i) + 6)); \
+	ROUND(b, c, d, e, f, g, h, a, (i) + 7, W((i) + 7)); \
+} while (0)
+
+static uint32_t load_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | p[3];
+}
+
+static void store_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+static void sha256_scalar_blocks(uint32_t state[8], const uint8_t *data,
+		uint64_t blocks)
+{
+	uint32_t w[16];
+	uint32_t a, b, c, d, e, f, g, h;
+	uint32_t i;
+
+	for (; blocks; --blocks, data += SHA256_BLOCK_SIZE) {
+		for (i = 0; i < 16; ++i)
+			w[i] = load_be32(data + i * 4);
+
+		a = state[0];
+		b = state[1];
+		c = state[2];
+		d = state[3];
+		e = state[4];
+		f = state[5];
+		g = state[6];
+		h = state[7];
+
+		for (i = 0; i < 64; i += 8) {
+			if (i >= 16) {
+				EXPAND(i + 0);
+				EXPAND(i + 1);
+				EXPAND(i + 2);
+				EXPAND(i + 3);
+				EXPAND(i + 4);
+				EXPAND(i + 5);
+				EXPAND(i + 6);
+				EXPAND(i + 7);
+			}
+			ROUNDS8(i);
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+	}
+}
+
+static void sha256_blocks(uint32_t state[8], const uint8_t *data,
+		uint64_t blocks)
+{
+	if (use_sha_ni)
+		sha256_ni_blocks(state, data, blocks);
+	else
+		sha256_scalar_blocks(state, data, blocks);
+}
+
+void sha256_init(sha256_ctx_t *ctx)
+{
+	/* SHA-NI needs the SSSE3/SSE4.1 shuffles as well, and SSE enabled */
+	use_sha_ni = (cpu_simd_level() != SIMD_NONE) &&
+		cpu_has_feature(X86_FEATURE_SHA_NI) &&
+		cpu_has_feature(X86_FEATURE_SSSE3) &&
+		cpu_has_feature(X86_FEATURE_SSE4_1);
+
+	ctx->state[0] = 0x6a09e667;
+	ctx->state[1] = 0xbb67ae85;
+	ctx->state[2] = 0x3c6ef372;
+	ctx->state[3] = 0xa54ff53a;
+	ctx->state[4] = 0x510e527f;
+	ctx->state[5] = 0x9b05688c;
+	ctx->state[6] = 0x1f83d9ab;
+	ctx->state[7] = 0x5be0cd19;
+	ctx->length = 0;
+}
+
+void sha256_update(sha256_ctx_t *ctx, const void *data, uint64_t size)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	uint64_t used = ctx->length % SHA256_BLOCK_SIZE;
+	uint64_t n;
+
+	ctx->length += size;
+
+	if (used) {
+		n = MIN(size, SHA256_BLOCK_SIZE - used);
+		memcpy(ctx->buffer + used, p, n);
+		p += n;
+		size -= n;
+		if (used + n < SHA256_BLOCK_SIZE)
+			return;
+		sha256_blocks(ctx->state, ctx->buffer, 1);
+	}
+
+	if (size >= SHA256_BLOCK_SIZE) {
+		n = size / SHA256_BLOCK_SIZE;
+		sha256_blocks(ctx->state, p, n);
+		p += n * SHA256_BLOCK_SIZE;
+		size -= n * SHA256_BLOCK_SIZE;
+	}
+
+	if (size)
+		memcpy(ctx->buffer, p, size);
+}
+
+void sha256_update_copy(sha256_ctx_t *ctx, void *dest, const void *src,
+		uint64_t size)
+{
+	uint8_t *d = (uint8_t *)dest;
+	const uint8_t *s = (const uint8_t *)src;
+	uint64_t used = ctx->length % SHA256_BLOCK_SIZE;
+	uint64_t blocks;
+	uint64_t total;
+	uint64_t n;
+
+	if (!use_sha_ni) {
+		total = size;
+		for (; size; size -= n, d += n, s += n) {
+			n = MIN(size, SHA256_COPY_CHUNK);
+			sha256_update(ctx, s, n);
+			memcpy_stream_part(d, s, n, total);
+		}
+		memcpy_stream_end();
+		return;
+	}
+
+	/* finish the buffered block, then whole blocks go straight through */
+	if (used) {
+		n = MIN(size, SHA256_BLOCK_SIZE - used);
+		sha256_update(ctx, s, n);
+		memcpy(d, s, n);
+		d += n;
+		s += n;
+		size -= n;
+	}
+
+	blocks = size / SHA256_BLOCK_SIZE;
+	if (blocks) {
+		sha256_ni_copy_blocks(ctx->state, d, s, blocks);
+		ctx->length += blocks * SHA256_BLOCK_SIZE;
+		d += blocks * SHA256_BLOCK_SIZE;
+		s += blocks * SHA256_BLOCK_SIZE;
+		size -= blocks * SHA256_BLOCK_SIZE;
+	}
+
+	if (size) {
+		sha256_update(ctx, s, size);
+		memcpy(d, s, size);
+	}
+}
+
+void sha256_final(sha256_ctx_t *ctx, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	uint64_t used = ctx->length % SHA256_BLOCK_SIZE;
+	uint64_t bits = ctx->length * 8;
+	uint32_t i;
+
+	ctx->buffer[used++] = 0x80;
+	if (used > SHA256_BLOCK_SIZE - 8) {
+		memset(ctx->buffer + used, 0, SHA256_BLOCK_SIZE - used);
+		sha256_blocks(ctx->state, ctx->buffer, 1);
+		used = 0;
+	}
+	memset(ctx->buffer + used, 0, SHA256_BLOCK_SIZE - 8 - used);
+
+	store_be32(ctx->buffer + SHA256_BLOCK_SIZE - 8, (uint32_t)(bits >> 32));
+	store_be32(ctx->buffer + SHA256_BLOCK_SIZE - 4, (uint32_t)bits);
+	sha256_blocks(ctx->state, ctx->buffer, 1);
+
+	for (i = 0; i < 8; ++i)
+		store_be32(digest + i * 4, ctx->state[i]);
+}
@@ -0,0 +1,49 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef _SHA256_H_
+#define _SHA256_H_
+
+#include "trusty_loader_base.h"
+
+#define SHA256_DIGEST_SIZE      32
+#define SHA256_BLOCK_SIZE       64
+
+typedef struct {
+	uint32_t	state[8];
+	uint64_t	length;                 /* bytes hashed so far */
+	uint8_t		buffer[SHA256_BLOCK_SIZE];
+} sha256_ctx_t;
+
+/* the SHA-NI kernel is used when the CPU has it and cpu_init() enabled
+ * SSE, sha256_init() picks it up */
+void sha256_init(sha256_ctx_t *ctx);
+void sha256_update(sha256_ctx_t *ctx, const void *data, uint64_t size);
+void sha256_final(sha256_ctx_t *ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+/* same as sha256_update() of src followed by memcpy_stream() to dest, but
+ * src is read only once: the SHA-NI kernel stores each block while it is
+ * in registers, the scalar code copies what it just hashed out of L1.
+ */
+void sha256_update_copy(sha256_ctx_t *ctx, void *dest, const void *src,
+		uint64_t size);
+
+/* compress whole blocks, sha256_ni.S */
+void sha256_ni_blocks(uint32_t state[8], const uint8_t *data, uint64_t blocks);
+void sha256_ni_copy_blocks(uint32_t state[8], uint8_t *dest,
+		const uint8_t *src, uint64_t blocks);
+
+#endif
@@ -27,7 +27,72 @@
 
 #define DEFAULT_POINTER_WIDTH   8
 /* 0xFFFFFFFFFFFFFFFFULL = 1.8*10^19 */
-#define MAX_NUMBER_CHARS 19
+#define MAX_NUMBER_CHARS 20
+
+/* "00" to "99", two decimal digits per step */
+static const char dec_pairs[200] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static const uint64_t pow10_table[MAX_NUMBER_CHARS] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL,
+	10000000000000000000ULL,
+};
+
+/* number of digits of value, from its bit length */
+static uint32_t count_digits(uint64_t value, uint32_t flags)
+{
+	uint32_t bits = 64 - (uint32_t)__builtin_clzll(value | 1);
+	uint32_t guess;
+
+	if (flags & HEX_TYPE) {
+		return (bits + 3) >> 2;
+	}
+
+	/* bits * log10(2), 1233/4096 is just above it. the guess is the
+	 * digit count or one less, value | 1 keeps 0 at one digit */
+	guess = (bits * 1233) >> 12;
+	return guess + ((value | 1) >= pow10_table[guess]);
+}
+
+/* write the digits of value so they end right before end */
+static void write_digits(char *end, uint64_t value, uint32_t flags)
+{
+	const char *hex_chars;
+	uint32_t pair;
+
+	if (flags & HEX_TYPE) {
+		hex_chars = (flags & UPHEX) ? "0123456789ABCDEF" : "0123456789abcdef";
+		do {
+			*(--end) = hex_chars[value & 0xF];
+			value >>= 4;
+		}while (value != 0);
+		return;
+	}
+
+	/* the compiler turns the constant divisions into multiplications */
+	while (value >= 100) {
+		pair = (uint32_t)(value % 100) * 2;
+		value /= 100;
+		*(--end) = dec_pairs[pair + 1];
+		*(--end) = dec_pairs[pair];
+	}
+
+	if (value >= 10) {
+		pair = (uint32_t)value * 2;
+		*(--end) = dec_pairs[pair + 1];
+		*(--end) = dec_pairs[pair];
+	}else {
+		*(--end) = (char)('0' + value);
+	}
+}
 
 /* ++
  * Routine Description:
@@ -43,32 +108,24 @@
  * Notes:
  *     if width is less than the actual length of the value, the width is ignored.
  *     others, write '0' or ' ' on the left of the string according to flags.
+ *     the digits are counted first and written in place from the last one,
+ *     only a value cut off by the end of the buffer goes through a temporary.
  * -- */
 static
 uint32_t ull2str(char *buffer_start, uint32_t buffer_size, uint64_t value, uint32_t flags, uint32_t width)
 {
-	uint32_t base;
 	char prefix;
 	uint32_t actual_len = 0;
 	char temp_buffer[MAX_NUMBER_CHARS];
-	char *temp_ptr = temp_buffer;
 	char *buffer = buffer_start;
 	uint64_t uvalue = value;
-	uint64_t remainder;
-	long long sint64;
-	int sint32;
-	uint32_t i;
+	uint32_t digits;
+	uint32_t pad;
 
 	if (buffer_size == 0){
 		return 0;
 	}
 
-	if (flags & HEX_TYPE) {
-		base = 16;
-	}else {
-		base = 10;
-	}
-
 	if (flags & PREFIX_ZERO) {
 		prefix = '0';
 	}else {
@@ -77,54 +134,38 @@ uint32_t ull2str(char *buffer_start, uint32_t buffer_size, uint64_t value, uint3
 
 	if (flags & SIGNED) {
 		if (flags & LONG_TYPE) {
-			sint64 = (long long)uvalue;
-			if (sint64 < 0) {
+			if ((long long)uvalue < 0) {
+				uvalue = 0 - uvalue;
 				*(buffer++) = '-';
-				uvalue = (uint64_t)-sint64;
 				actual_len++;
 				buffer_size--;
 			}
 		}else {
-			sint32 = (int)uvalue;
-			if (sint32 < 0) {
+			if ((int)uvalue < 0) {
+				uvalue = 0 - (uint64_t)(long long)(int)uvalue;
 				*(buffer++) = '-';
-				uvalue = (uint64_t)-sint32;
 				actual_len++;
 				buffer_size--;
 			}
 		}
 	}
 
-	do {
-		remainder = (uint64_t)(uvalue % base);
-		uvalue = uvalue / base;
-
-		if (remainder > 9) {
-			if (flags & UPHEX) {
-				*(temp_ptr++) = remainder + 'A' - 10;
-			}else {
-				*(temp_ptr++) = remainder + 'a' - 10;
-			}
-		}else {
-			*(temp_ptr++) = remainder + '0';
-		}
-		actual_len++;
-	}while (uvalue != 0);/* temp buffer will never overflow here, see comments of MAX_NUMBER_CHARS */
-
-	for (i = actual_len; i < width; i++) {
-		if (buffer_size == 0)
-			break;
-
-		*(buffer++) = prefix;
-		buffer_size--;
-	}
+	digits = count_digits(uvalue, flags);
+	actual_len += digits;
 
-	while (temp_ptr != temp_buffer) {
-		if (buffer_size == 0)
-			break;
+	pad = (width > actual_len) ? width - actual_len : 0;
+	pad = MIN(pad, buffer_size);
+	memset(buffer, (uint8_t)prefix, pad);
+	buffer += pad;
+	buffer_size -= pad;
 
-		*(buffer++) = *(--temp_ptr);
-		buffer_size--;
+	if (digits <= buffer_size) {
+		write_digits(buffer + digits, uvalue, flags);
+		buffer += digits;
+	}else {
+		write_digits(temp_buffer + MAX_NUMBER_CHARS, uvalue, flags);
+		memcpy(buffer, temp_buffer + MAX_NUMBER_CHARS - digits, buffer_size);
+		buffer += buffer_size;
 	}
 
 	return (uint32_t)(buffer - buffer_start);
@@ -145,14 +186,20 @@ uint32_t ull2str(char *buffer_start, uint32_t buffer_size, uint64_t value, uint3
 static
 const char *get_flags_and_width(const char *format, uint32_t *flags, uint32_t *width)
 {
-	const char *endptr;
+	const char *endptr = format;
+	uint64_t value = 0;
 
 	*flags = 0;
-	*width = str2uint(format, 32, &endptr, 10);
 
-	if (*width == (uint32_t)-1) {
-		*width = 0;
+	/* str2uint() in base 10, without its per character base checks */
+	for (; *endptr >= '0' && *endptr <= '9'; endptr++) {
+		value = value * 10 + (uint32_t)(*endptr - '0');
+		if (value >> 32) {
+			value = 0;
+			break;
+		}
 	}
+	*width = (uint32_t)value;
 
 	if (*format == '0') {
 		*flags |= PREFIX_ZERO;
@@ -263,6 +310,7 @@ static const char *parse_format(char *buffer_start, uint32_t buffer_size, const
 		case 'd':
 			/* UNSIGNED DECIMAL */
 			flags |= SIGNED;
+			/* fall through */
 		case 'u':
 			value = get_value(argptr, flags);
 			count = ull2str(buffer_start, buffer_size, value, flags, width);
@@ -270,6 +318,7 @@ static const char *parse_format(char *buffer_start, uint32_t buffer_size, const
 
 		case 'X':
 			flags |= UPHEX;
+			/* fall through */
 		case 'x':
 			flags |= HEX_TYPE;
 			value = get_value(argptr, flags);
@@ -279,6 +328,7 @@ static const char *parse_format(char *buffer_start, uint32_t buffer_size, const
 		case 'P':
 			/* POINTER LOWER CASE */
 			flags |= UPHEX;
+			/* fall through */
 		case 'p':
 			flags |= PREFIX_ZERO | LONG_TYPE | HEX_TYPE;
 
@@ -0,0 +1,121 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+#include "timeline.h"
+#include "cpu.h"
+#include "print.h"
+#include "util.h"
+
+/* a char table, not pointers: the loader runs where it is loaded and
+ * nothing relocates its data */
+static const char phase_names[TL_PHASES][10] = {
+	"entry", "cmdline", "validate", "copy", "zero", "relocate",
+	"hypercall", "handoff",
+};
+
+static timeline_entry_t timeline[TL_PHASES];
+static uint64_t entry_tsc;
+static uint64_t tsc_khz;
+
+/* leaf 0x15 gives the TSC/crystal ratio and, on most parts, the crystal
+ * clock. without the clock, leaf 0x16 has the base frequency the TSC runs
+ * at. 0 if neither is there, the summary is in cycles then.
+ */
+static uint64_t tsc_calibrate(void)
+{
+	uint32_t eax, ebx, ecx, edx;
+	uint32_t max_leaf;
+
+	cpuid(0, 0, &max_leaf, &ebx, &ecx, &edx);
+
+	if (max_leaf >= 0x15) {
+		cpuid(0x15, 0, &eax, &ebx, &ecx, &edx);
+		if (eax && ebx && ecx)
+			return (uint64_t)ecx * ebx / eax / 1000;
+	}
+
+	if (max_leaf >= 0x16) {
+		cpuid(0x16, 0, &eax, &ebx, &ecx, &edx);
+		if (eax & 0xFFFF)
+			return (uint64_t)(eax & 0xFFFF) * 1000;
+	}
+
+	return 0;
+}
+
+void timeline_init(void)
+{
+	entry_tsc = rdtsc();
+
+	memset(timeline, 0, sizeof(timeline));
+	timeline[TL_ENTRY].cycles = entry_tsc;
+	timeline[TL_ENTRY].count = 1;
+
+	tsc_khz = tsc_calibrate();
+}
+
+uint64_t timeline_add(uint32_t phase, uint64_t start, uint64_t bytes)
+{
+	uint64_t now = rdtsc();
+
+	if (phase < TL_PHASES) {
+		timeline[phase].cycles += now - start;
+		timeline[phase].bytes += bytes;
+		timeline[phase].count++;
+	}
+
+	return now;
+}
+
+/* microseconds, or cycles without a TSC frequency */
+static uint64_t tsc_to_us(uint64_t cycles)
+{
+	return tsc_khz ? cycles * 1000 / tsc_khz : cycles;
+}
+
+void timeline_print(void)
+{
+	const char *unit = tsc_khz ? "us" : "cycles";
+	uint32_t i;
+
+	printf("trusty loader: boot %lu%s:", tsc_to_us(rdtsc() - entry_tsc), unit);
+
+	for (i = 0; i < TL_PHASES; ++i) {
+		if (0 == timeline[i].count)
+			continue;
+
+		printf(" %s %lu%s", phase_names[i], tsc_to_us(timeline[i].cycles),
+				unit);
+		if (timeline[i].bytes)
+			printf("/0x%lx", timeline[i].bytes);
+	}
+
+	printf(", TSC %lu kHz\n", tsc_khz);
+}
+
+const timeline_entry_t *timeline_get(uint32_t phase)
+{
+	return (phase < TL_PHASES) ? &timeline[phase] : NULL;
+}
+
+const char *timeline_phase_name(uint32_t phase)
+{
+	return (phase < TL_PHASES) ? phase_names[phase] : "?";
+}
+
+uint64_t timeline_tsc_khz(void)
+{
+	return tsc_khz;
+}
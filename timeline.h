@@ -0,0 +1,57 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef _TIMELINE_H_
+#define _TIMELINE_H_
+
+#include "trusty_loader_base.h"
+
+/* boot phases, each one sums the TSC cycles and bytes of its spans */
+#define TL_ENTRY                0       /* reset to trusty_loader_main() */
+#define TL_CMDLINE              1
+#define TL_VALIDATE             2       /* finding the image, header and digest checks */
+#define TL_COPY                 3       /* segment data, hashed or decompressed on the way */
+#define TL_ZERO                 4       /* trusty bss */
+#define TL_RELOCATE             5       /* alternatives and relocations */
+#define TL_HYPERCALL            6       /* HC_INITIALIZE_TRUSTY */
+#define TL_HANDOFF              7       /* back from trusty to the UART flush for Linux */
+#define TL_PHASES               8
+
+typedef struct {
+	uint64_t	cycles;
+	uint64_t	bytes;
+	uint32_t	count;                  /* spans added */
+	uint32_t	reserved;
+} timeline_entry_t;
+
+/* stamp TL_ENTRY and calibrate the TSC from cpuid 0x15/0x16, call it
+ * first thing in trusty_loader_main() */
+void timeline_init(void);
+
+/* add the span from start, an rdtsc() value, to now to phase. returns
+ * now, so back to back spans need only one TSC read each.
+ */
+uint64_t timeline_add(uint32_t phase, uint64_t start, uint64_t bytes);
+
+/* one line with the time and bytes of each phase since entry */
+void timeline_print(void);
+
+/* for a harness that keeps its own statistics, see tools/host_elf.c */
+const timeline_entry_t *timeline_get(uint32_t phase);
+const char *timeline_phase_name(uint32_t phase);
+uint64_t timeline_tsc_khz(void);
+
+#endif
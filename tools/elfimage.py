@@ -0,0 +1,198 @@
+################################################################################
+# Copyright (c) 2018 Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+################################################################################
+
+"""Minimal ELF64 little-endian reader shared by the packaging tools.
+
+Only what the trusty loader consumes is modelled: the ELF header, the
+program headers and the dynamic section. Layouts follow elf_ld.h.
+"""
+
+import struct
+
+EHDR = struct.Struct('<16sHHIQQQIHHHHHH')
+PHDR = struct.Struct('<IIQQQQQQ')
+DYN = struct.Struct('<QQ')
+RELA = struct.Struct('<QQq')
+SYM = struct.Struct('<IBBHQQ')
+SHDR = struct.Struct('<IIQQQQIIQQ')
+
+ELFCLASS64 = 2
+ELFDATA2LSB = 1
+EM_X86_64 = 62
+
+PT_LOAD = 1
+PT_DYNAMIC = 2
+
+DT_NULL = 0
+DT_PLTRELSZ = 2
+DT_SYMTAB = 6
+DT_RELA = 7
+DT_RELASZ = 8
+DT_RELAENT = 9
+DT_DEBUG = 21
+DT_JMPREL = 23
+DT_RELRSZ = 35
+DT_RELR = 36
+DT_RELRENT = 37
+DT_RELACOUNT = 0x6ffffff9
+
+R_X86_64_NONE = 0
+R_X86_64_64 = 1
+R_X86_64_GLOB_DAT = 6
+R_X86_64_JMP_SLOT = 7
+R_X86_64_RELATIVE = 8
+R_X86_64_32 = 10
+R_X86_64_IRELATIVE = 37
+
+SHN_UNDEF = 0
+SHN_ABS = 0xfff1
+STB_WEAK = 2
+
+PF_X = 0x1
+PF_W = 0x2
+PF_R = 0x4
+
+
+class Phdr(object):
+    FIELDS = ('p_type', 'p_flags', 'p_offset', 'p_vaddr', 'p_paddr',
+              'p_filesz', 'p_memsz', 'p_align')
+
+    def __init__(self, raw):
+        for name, value in zip(self.FIELDS, PHDR.unpack(raw)):
+            setattr(self, name, value)
+
+    def pack(self):
+        return PHDR.pack(*[getattr(self, name) for name in self.FIELDS])
+
+
+class Shdr(object):
+    FIELDS = ('sh_name', 'sh_type', 'sh_flags', 'sh_addr', 'sh_offset',
+              'sh_size', 'sh_link', 'sh_info', 'sh_addralign', 'sh_entsize')
+
+    def __init__(self, raw):
+        for name, value in zip(self.FIELDS, SHDR.unpack(raw)):
+            setattr(self, name, value)
+
+    def pack(self):
+        return SHDR.pack(*[getattr(self, name) for name in self.FIELDS])
+
+
+class ElfImage(object):
+    FIELDS = ('e_ident', 'e_type', 'e_machine', 'e_version', 'e_entry',
+              'e_phoff', 'e_shoff', 'e_flags', 'e_ehsize', 'e_phentsize',
+              'e_phnum', 'e_shentsize', 'e_shnum', 'e_shstrndx')
+
+    def __init__(self, data):
+        self.data = bytearray(data)
+        if len(self.data) < EHDR.size or self.data[:4] != b'\x7fELF':
+            raise ValueError('not an ELF file')
+        for name, value in zip(self.FIELDS, EHDR.unpack_from(self.data)):
+            setattr(self, name, value)
+        if (self.e_ident[4] != ELFCLASS64 or self.e_ident[5] != ELFDATA2LSB
+                or self.e_machine != EM_X86_64):
+            raise ValueError('not an x86-64 ELF64 file')
+        self.phdrs = [Phdr(self.data[off:off + PHDR.size])
+                      for off in self.phdr_offsets()]
+
+    @classmethod
+    def from_file(cls, path):
+        with open(path, 'rb') as f:
+            return cls(f.read())
+
+    def phdr_offsets(self):
+        return [self.e_phoff + i * self.e_phentsize
+                for i in range(self.e_phnum)]
+
+    def header_size(self):
+        """Bytes of the file taken by the ELF header and program headers."""
+        return max(self.e_ehsize,
+                   self.e_phoff + self.e_phnum * self.e_phentsize)
+
+    def shdrs(self):
+        if not self.e_shoff or self.e_shentsize != SHDR.size:
+            return []
+        return [Shdr(self.data[off:off + SHDR.size]) for off in
+                range(self.e_shoff, self.e_shoff + self.e_shnum * SHDR.size,
+                      SHDR.size)]
+
+    def section(self, name):
+        """The section header called name, None if there is none."""
+        shdrs = self.shdrs()
+        if self.e_shstrndx >= len(shdrs):
+            return None
+        strtab = shdrs[self.e_shstrndx]
+        names = self.data[strtab.sh_offset:strtab.sh_offset + strtab.sh_size]
+        for shdr in shdrs:
+            end = names.find(b'\0', shdr.sh_name)
+            if names[shdr.sh_name:end] == name.encode():
+                return shdr
+        return None
+
+    def section_headers_blob(self, offset):
+        """Section headers followed by the section name table, rebased to
+        be stored at file offset 'offset'. Returns (blob, e_shoff)."""
+        shdrs = self.shdrs()
+        if not shdrs or self.e_shstrndx >= len(shdrs):
+            return b'', 0
+        strtab = shdrs[self.e_shstrndx]
+        names = bytes(self.data[strtab.sh_offset:
+                                strtab.sh_offset + strtab.sh_size])
+        strtab.sh_offset = offset + len(shdrs) * SHDR.size
+        return b''.join(s.pack() for s in shdrs) + names, offset
+
+    def loads(self):
+        return [p for p in self.phdrs if p.p_type == PT_LOAD and p.p_memsz]
+
+    def dynamic_phdr(self):
+        for p in self.phdrs:
+            if p.p_type == PT_DYNAMIC:
+                return p
+        return None
+
+    def dynamic(self):
+        """The dynamic section as a list of (tag, value), DT_NULL excluded."""
+        for p in self.phdrs:
+            if p.p_type != PT_DYNAMIC:
+                continue
+            entries = []
+            for off in range(p.p_offset, p.p_offset + p.p_filesz, DYN.size):
+                tag, val = DYN.unpack_from(self.data, off)
+                if tag == 0:
+                    break
+                entries.append((tag, val))
+            return entries
+        return []
+
+    def write_dynamic(self, entries):
+        """Rewrite the dynamic section in place, padding it with DT_NULL."""
+        p = self.dynamic_phdr()
+        slots = p.p_filesz // DYN.size
+        if len(entries) >= slots:
+            raise ValueError('dynamic section has %d slots, %d entries needed'
+                             % (slots, len(entries) + 1))
+        for i in range(slots):
+            tag, val = entries[i] if i < len(entries) else (DT_NULL, 0)
+            DYN.pack_into(self.data, p.p_offset + i * DYN.size, tag, val)
+
+    def vaddr_to_offset(self, vaddr):
+        for p in self.loads():
+            if p.p_vaddr <= vaddr < p.p_vaddr + p.p_filesz:
+                return p.p_offset + vaddr - p.p_vaddr
+        raise ValueError('address 0x%x is not backed by file data' % vaddr)
+
+    def write_phdrs(self):
+        for off, p in zip(self.phdr_offsets(), self.phdrs):
+            self.data[off:off + PHDR.size] = p.pack()
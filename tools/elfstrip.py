@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+################################################################################
+# Copyright (c) 2018 Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+################################################################################
+
+"""Strip lk.elf down to what relocate_elf_image() reads.
+
+The file is rewritten as
+
+    ELF header, program headers
+    PT_LOAD file contents, each at an offset congruent to its p_vaddr
+    modulo 4K, so segments start page aligned in the file
+    section names, section headers
+
+A p_align above 4K is kept for the placement but no longer holds for the
+file offsets, the loader copies or maps segments 4K at a time.
+
+PT_LOAD segments with the same flags that follow each other both in the
+file and in memory are merged, and only SHF_ALLOC sections keep a section
+header (the loader looks up .altinstructions by name). Debug info, the
+symbol table and any other non-loadable contents are dropped. Program
+headers whose contents lie outside the PT_LOAD data go too, PT_DYNAMIC
+and PT_GNU_RELRO are always inside it.
+"""
+
+import argparse
+import copy
+import sys
+
+from elfimage import ElfImage, EHDR, PHDR, SHDR, PT_LOAD
+
+PAGE = 4096
+
+SHT_NOBITS = 8
+SHT_REL = 9
+SHT_RELA = 4
+SHF_ALLOC = 0x2
+SHF_INFO_LINK = 0x40
+
+
+def merge_loads(loads):
+    """Merged copies of loads, in p_vaddr order. Each copy remembers the
+    file offset it was read from in old_offset."""
+    merged = []
+    for p in sorted(loads, key=lambda p: p.p_vaddr):
+        q = merged[-1] if merged else None
+        if (q and q.p_flags == p.p_flags and q.p_filesz == q.p_memsz and
+                p.p_offset == q.old_offset + q.p_filesz and
+                p.p_vaddr == q.p_vaddr + q.p_memsz and
+                p.p_paddr == q.p_paddr + q.p_memsz):
+            q.p_filesz += p.p_filesz
+            q.p_memsz += p.p_memsz
+            q.p_align = max(q.p_align, p.p_align)
+            q.members.append(p)
+            continue
+        q = copy.copy(p)
+        q.old_offset = p.p_offset
+        q.members = [p]
+        merged.append(q)
+    return merged
+
+
+def strip(elf):
+    """Returns the stripped file and (PT_LOADs before, after)."""
+    loads = merge_loads(elf.loads())
+    header_size = elf.header_size()
+
+    # lay out the segment data, the one holding the headers stays at 0
+    cursor = header_size
+    for p in loads:
+        if p.old_offset == 0 and p.p_filesz:
+            if p.p_filesz < header_size:
+                raise ValueError('first PT_LOAD does not cover the headers')
+            p.p_offset = 0
+            cursor = max(cursor, p.p_filesz)
+    for p in loads:
+        if p.old_offset == 0 and p.p_filesz:
+            continue
+        p.p_offset = cursor + (p.p_vaddr - cursor) % PAGE
+        if p.p_filesz:
+            cursor = p.p_offset + p.p_filesz
+
+    def new_offset(offset, size=0):
+        for p in loads:
+            if (p.p_filesz and p.old_offset <= offset and
+                    offset + size <= p.old_offset + p.p_filesz):
+                return p.p_offset + offset - p.old_offset
+        return None
+
+    # program headers: the merged loads in place of their first member
+    phdrs = []
+    for old in elf.phdrs:
+        if old.p_type == PT_LOAD:
+            phdrs += [p for p in loads if p.members[0] is old]
+            continue
+        q = copy.copy(old)
+        if q.p_filesz:
+            q.p_offset = new_offset(old.p_offset, old.p_filesz)
+            if q.p_offset is None:
+                continue
+        phdrs.append(q)
+
+    out = bytearray(cursor)
+    for p in loads:
+        out[p.p_offset:p.p_offset + p.p_filesz] = \
+            elf.data[p.old_offset:p.old_offset + p.p_filesz]
+
+    # the phdr table shrinks in place, what is left of it is cleared
+    out[elf.e_phoff:elf.e_phoff + elf.e_phnum * elf.e_phentsize] = \
+        bytes(elf.e_phnum * elf.e_phentsize)
+    for i, p in enumerate(phdrs):
+        off = elf.e_phoff + i * elf.e_phentsize
+        out[off:off + PHDR.size] = p.pack()
+
+    # section headers of the SHF_ALLOC sections and the name table
+    shdrs = elf.shdrs()
+    keep = [i for i, s in enumerate(shdrs)
+            if i == 0 or i == elf.e_shstrndx or s.sh_flags & SHF_ALLOC]
+    index = dict((old, new) for new, old in enumerate(keep))
+    e_shoff = e_shnum = e_shstrndx = 0
+    if shdrs and elf.e_shstrndx in index:
+        kept = [copy.copy(shdrs[i]) for i in keep]
+        strtab = kept[index[elf.e_shstrndx]]
+        names = bytes(elf.data[strtab.sh_offset:
+                               strtab.sh_offset + strtab.sh_size])
+        out += bytes(-len(out) % 8)
+        strtab.sh_offset = len(out)
+        out += names + bytes(-len(names) % 8)
+
+        for s in kept[1:]:
+            s.sh_link = index.get(s.sh_link, 0)
+            if s.sh_flags & SHF_INFO_LINK or s.sh_type in (SHT_REL, SHT_RELA):
+                s.sh_info = index.get(s.sh_info, 0)
+            if s is strtab:
+                continue
+            if s.sh_type == SHT_NOBITS or not s.sh_size:
+                s.sh_offset = 0
+                for p in loads:
+                    if p.p_vaddr <= s.sh_addr <= p.p_vaddr + p.p_memsz:
+                        s.sh_offset = p.p_offset + s.sh_addr - p.p_vaddr
+                        break
+            else:
+                s.sh_offset = new_offset(s.sh_offset, s.sh_size)
+                if s.sh_offset is None:
+                    raise ValueError('section %d is SHF_ALLOC but not in a '
+                                     'PT_LOAD' % keep[kept.index(s)])
+
+        e_shoff, e_shnum = len(out), len(kept)
+        e_shstrndx = index[elf.e_shstrndx]
+        out += b''.join(s.pack() for s in kept)
+
+    fields = dict((name, getattr(elf, name)) for name in ElfImage.FIELDS)
+    fields.update(e_phnum=len(phdrs), e_shoff=e_shoff,
+                  e_shentsize=SHDR.size if e_shnum else 0,
+                  e_shnum=e_shnum, e_shstrndx=e_shstrndx)
+    out[:EHDR.size] = EHDR.pack(*[fields[name] for name in ElfImage.FIELDS])
+
+    return bytes(out), (len(elf.loads()), len(loads))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('input', help='trusty ELF image (lk.elf)')
+    parser.add_argument('output', help='ELF image to write')
+    args = parser.parse_args()
+
+    elf = ElfImage.from_file(args.input)
+    data, (before, after) = strip(elf)
+    with open(args.output, 'wb') as f:
+        f.write(data)
+
+    print('%s: %d -> %d bytes, %d PT_LOAD segments merged into %d'
+          % (args.output, len(elf.data), len(data), before, after))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
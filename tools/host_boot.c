@@ -0,0 +1,420 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+/*
+ * trusty_loader_main() end to end on the host, "make host-test" and
+ * "make host-bench". trusty_loader.c and everything it calls are
+ * built with the loader's own flags; host_shim.c is the platform (see
+ * platform.h), cpu.c and paging.c.
+ *
+ *     host_boot [-v] [-r ROUNDS] [-z] [-f] [-c ARGS] [-a ARGS]
+ *               [-e LOADER] IMAGE
+ *
+ * sets up what vSBL leaves the loader below 4G: the loader's header with
+ * no package and no digest, a multiboot info whose cmdline points at the
+ * image boot params, those and the Linux boot params, and IMAGE (ELF,
+ * LZ4 image, snapshot or package) as the "trusty" module. trusty memory
+ * is mapped at TRUSTY_RUNTIME_BASE, so snapshots prelinked for the real
+ * base take their fast path. each of ROUNDS boots then runs until the
+ * loader jumps to Linux, and is checked: one HC_INITIALIZE_TRUSTY with
+ * sane trusty boot params, Linux entered with the registers asked for.
+ * the fastest round is reported from the loader's timeline.
+ *
+ *   -c ARGS  more of the multiboot cmdline, before ImageBootParamsAddr,
+ *            which vSBL puts last
+ *   -a ARGS  more of the multiboot cmdline, after ImageBootParamsAddr
+ *   -e LOADER  IMAGE is LOADER with a package tools/mkpkg.py --embed
+ *            appended, loaded as vSBL would through its multiboot header
+ *            and with no module. the .bss that LOADER's own header gives
+ *            is filled as the loader's page tables and log would, before
+ *            the boot, so a package overlapping it is not found
+ *   -z       trusty memory is handed over zeroed
+ *   -f       the boot is expected to halt
+ *   -v       show the loader's log
+ *
+ * perf works on it as on any program:
+ *
+ *     perf record -g out/host_boot -r 100 out/host/t.elf
+ */
+#include "trusty_loader_base.h"
+#include "trusty_loader_asm.h"
+#include "boot_params.h"
+#include "hypercall.h"
+#include "print.h"
+#include "timeline.h"
+#include "string.h"
+#include "util.h"
+
+/* host_shim.c */
+#define HOST_BOOT_RETURNED      0
+#define HOST_BOOT_LINUX         1
+#define HOST_BOOT_HALT          2
+
+extern int host_console_verbose;
+void host_print(const char *fmt, ...);
+double host_now(void);
+uint64_t host_map(uint64_t base, uint64_t size);
+uint64_t host_read_file(const char *path, uint64_t *size);
+void *platform_mem(uint64_t addr, uint64_t size);
+int host_boot_run(void (*entry)(uint64_t *, uint64_t), uint64_t *mbi,
+		uint64_t loader_base, uint64_t *regs);
+const void *host_hypercall(uint32_t i, uint64_t *id);
+
+/* host_report.c */
+void host_report(const timeline_entry_t *phases, double wall);
+
+int strcmp(const char *a, const char *b);
+
+/* what vSBL leaves below 4G, one page each, then the module */
+#define HOST_LOW_BASE           0x10000000ULL
+#define HOST_LOADER_PAGE        0
+#define HOST_MBI_PAGE           1
+#define HOST_PARAMS_PAGE        2
+#define HOST_MODULE_PAGE        3
+
+#define HOST_CMDLINE_SIZE       2048
+#define HOST_MB_AOUT_KLUDGE     (1U << 16)
+#define HOST_POISON             0xA5
+
+/* what the Linux boot params ask for, checked at the handoff */
+static const uint32_t linux_regs[6] = {
+	0x01000000, 0x4c4e5852, 0x12345678, 0x0009e000, 0x00001000, 0x87654321,
+};
+
+/* the a.out kludge part of the multiboot header */
+typedef struct {
+	uint32_t	magic;
+	uint32_t	flags;
+	uint32_t	checksum;
+	uint32_t	header_addr;
+	uint32_t	load_addr;
+	uint32_t	load_end_addr;
+	uint32_t	bss_end_addr;
+	uint32_t	entry_addr;
+} host_mb_header_t;
+
+typedef struct {
+	const char	*image;
+	const char	*loader;
+	const char	*args;
+	const char	*tail;
+	uint32_t	rounds;
+	boolean_t	zeroed;
+	boolean_t	expect_fail;
+	uint32_t	padding;
+} host_args_t;
+
+typedef struct {
+	multiboot_info_t	info;
+	multiboot_module_t	module;
+	char			module_cmdline[8];
+	char			cmdline[HOST_CMDLINE_SIZE];
+} host_mbi_t;
+
+typedef struct {
+	image_boot_param_t	image;
+	linux_boot_param_t	linux_param;
+} host_params_t;
+
+static uint64_t page(uint32_t n)
+{
+	return HOST_LOW_BASE + (uint64_t)n * PAGE_4K_SIZE;
+}
+
+/* the multiboot header of a loader file, NULL if vSBL would refuse it */
+static const host_mb_header_t *mb_header(const char *path, uint64_t file,
+		uint64_t file_size)
+{
+	const host_mb_header_t *hdr = (const host_mb_header_t *)file;
+
+	if (file_size < sizeof(*hdr) || MULTIBOOT_HEADER_MAGIC != hdr->magic ||
+			!(hdr->flags & HOST_MB_AOUT_KLUDGE) ||
+			hdr->load_end_addr <= hdr->load_addr ||
+			hdr->load_end_addr - hdr->load_addr > file_size ||
+			(hdr->bss_end_addr &&
+			 hdr->bss_end_addr < hdr->load_end_addr)) {
+		host_print("%s: bad multiboot header\n", path);
+		return NULL;
+	}
+
+	return hdr;
+}
+
+/* the boot of trusty_loader_entry.S, below 4G since multiboot addresses
+ * are 32 bit. returns where the loader is, 0 on failure */
+static uint64_t setup(const host_args_t *args, uint64_t image,
+		uint64_t image_size)
+{
+	host_mbi_t *mbi = (host_mbi_t *)page(HOST_MBI_PAGE);
+	host_params_t *params = (host_params_t *)page(HOST_PARAMS_PAGE);
+	cpu_boot_state_t *cpu = &params->linux_param.cpu_state;
+	const host_mb_header_t *hdr = NULL;
+	const host_mb_header_t *own = NULL;
+	uint64_t loader, loader_size, load_size, bss_size;
+	uint64_t own_bss_end = 0;
+	uint64_t span = image_size;
+	uint64_t base = page(HOST_LOADER_PAGE);
+	uint64_t size;
+
+	if (args->loader) {
+		loader = host_read_file(args->loader, &loader_size);
+		if (!loader) {
+			host_print("%s: cannot read it\n", args->loader);
+			return 0;
+		}
+		hdr = mb_header(args->image, image, image_size);
+		own = mb_header(args->loader, loader, loader_size);
+		if (!hdr || !own)
+			return 0;
+		own_bss_end = MAX(own->load_end_addr, own->bss_end_addr);
+		span = MAX(hdr->load_end_addr, hdr->bss_end_addr) -
+			hdr->load_addr;
+		span = MAX(span, own_bss_end - own->load_addr);
+		base = page(HOST_MODULE_PAGE);
+	}
+
+	size = page(HOST_MODULE_PAGE) - HOST_LOW_BASE + PAGE_ALIGN_4K(span);
+	if (!host_map(HOST_LOW_BASE, size)) {
+		host_print("cannot map 0x%llx bytes at 0x%llx\n", size,
+				HOST_LOW_BASE);
+		return 0;
+	}
+
+	if (hdr) {
+		/* vSBL: the file to load_end_addr, zeroes to bss_end_addr */
+		load_size = hdr->load_end_addr - hdr->load_addr;
+		bss_size = hdr->bss_end_addr ?
+			hdr->bss_end_addr - hdr->load_end_addr : 0;
+		memcpy((void *)base, (const void *)image, load_size);
+		memset((void *)(base + load_size), 0, bss_size);
+
+		/* the loader: its page tables and log in its .bss */
+		memset((void *)(base + own->load_end_addr - own->load_addr),
+				HOST_POISON, own_bss_end - own->load_end_addr);
+	} else {
+		/* the loader's header: no package, no digest */
+		memset((void *)base, 0, PAGE_4K_SIZE);
+
+		memcpy((void *)page(HOST_MODULE_PAGE), (const void *)image,
+				image_size);
+		memcpy(mbi->module_cmdline, TRUSTY_MODULE_NAME,
+				sizeof(TRUSTY_MODULE_NAME));
+		mbi->module.mod_start = (uint32_t)page(HOST_MODULE_PAGE);
+		mbi->module.mod_end = (uint32_t)(page(HOST_MODULE_PAGE) +
+				image_size);
+		mbi->module.cmdline = (uint32_t)(uint64_t)mbi->module_cmdline;
+		mbi->info.mods_count = 1;
+		mbi->info.mods_addr = (uint32_t)(uint64_t)&mbi->module;
+	}
+
+	vmm_sprintf_s(mbi->cmdline, HOST_CMDLINE_SIZE,
+			"console=ttyS0 %s ImageBootParamsAddr=0x%lx %s",
+			args->args ? args->args : "", (uint64_t)&params->image,
+			args->tail ? args->tail : "");
+	mbi->info.flags = (1 << 2) | (1 << 3);
+	mbi->info.cmdline = (uint32_t)(uint64_t)mbi->cmdline;
+
+	params->image.size_of_struct = sizeof(image_boot_param_t);
+	params->image.version = 1;
+	params->image.vmm_boot_param_addr = (uint64_t)&params->linux_param;
+	if (args->zeroed) {
+		params->image.zeroed_mem_base = TRUSTY_RUNTIME_BASE +
+			TRUSTY_RSVD_SIZE;
+		params->image.zeroed_mem_size = TRUSTY_RUNTIME_TOTAL_SIZE;
+	}
+
+	params->linux_param.size_of_struct = sizeof(linux_boot_param_t);
+	params->linux_param.version = 1;
+	cpu->eip = linux_regs[0];
+	cpu->eax = linux_regs[1];
+	cpu->ebx = linux_regs[2];
+	cpu->esi = linux_regs[3];
+	cpu->edi = linux_regs[4];
+	cpu->ecx = linux_regs[5];
+
+	return base;
+}
+
+/* what a boot left for ACRN and Linux */
+static boolean_t check_boot(const uint64_t *regs)
+{
+	const trusty_boot_param_t *param;
+	uint64_t base, entry, id;
+	uint32_t i;
+
+	param = host_hypercall(0, &id);
+	if (!param || HC_INITIALIZE_TRUSTY != id || host_hypercall(1, &id)) {
+		host_print("  expected one HC_INITIALIZE_TRUSTY\n");
+		return FALSE;
+	}
+
+	base = ((uint64_t)param->base_addr_high << 32) | param->base_addr;
+	entry = ((uint64_t)param->entry_point_high << 32) | param->entry_point;
+	if (TRUSTY_BOOT_PARAM_SIZE != param->size_of_struct ||
+			TRUSTY_BOOT_PARAM_VERSION != param->version ||
+			TRUSTY_RUNTIME_BASE != base ||
+			TRUSTY_MEM_SIZE != param->mem_size ||
+			entry < base + TRUSTY_RSVD_SIZE + TRUSTY_64BIT_ENTRY_OFFSET ||
+			entry >= base + TRUSTY_MEM_SIZE) {
+		host_print("  bad trusty boot params: version %u, size 0x%x, base "
+				"0x%llx, memory 0x%x, entry 0x%llx\n", param->version,
+				param->size_of_struct, base, param->mem_size, entry);
+		return FALSE;
+	}
+
+#ifdef TRUSTY_BOOT_PARAMS_V3
+	if (param->load_base < base + TRUSTY_RSVD_SIZE ||
+			entry < param->load_base + TRUSTY_64BIT_ENTRY_OFFSET ||
+			0 == param->segment_count ||
+			param->segment_count > ELF_MAX_LOAD_SEGMENTS) {
+		host_print("  bad version 3 trusty boot params: load base 0x%llx, "
+				"%u segments\n", param->load_base, param->segment_count);
+		return FALSE;
+	}
+	for (i = 0; i < param->segment_count; ++i) {
+		if (param->segments[i].base < param->load_base ||
+				param->segments[i].base + param->segments[i].size >
+				base + TRUSTY_MEM_SIZE) {
+			host_print("  segment %u at 0x%llx+0x%llx out of trusty "
+					"memory\n", i, param->segments[i].base,
+					param->segments[i].size);
+			return FALSE;
+		}
+	}
+#endif
+
+	for (i = 0; i < 6; ++i) {
+		if (regs[i] != linux_regs[i]) {
+			host_print("  Linux entered with register %u 0x%llx, expected "
+					"0x%x\n", i, regs[i], linux_regs[i]);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static int run(const host_args_t *args)
+{
+	timeline_entry_t best[TL_PHASES];
+	uint64_t regs[6];
+	uint64_t image, size, loader;
+	uint8_t *runtime;
+	double best_wall = 0, wall;
+	int ret = HOST_BOOT_RETURNED;
+	uint32_t round, i;
+
+	image = host_read_file(args->image, &size);
+	if (!image) {
+		host_print("%s: cannot read it\n", args->image);
+		return 2;
+	}
+
+	loader = setup(args, image, size);
+	if (!loader)
+		return 2;
+
+	runtime = platform_mem(TRUSTY_RUNTIME_BASE,
+			TRUSTY_RSVD_SIZE + TRUSTY_RUNTIME_TOTAL_SIZE);
+	if (!runtime) {
+		host_print("cannot map trusty memory at 0x%llx\n",
+				TRUSTY_RUNTIME_BASE);
+		return 2;
+	}
+
+	for (round = 0; round < args->rounds; ++round) {
+		memset(runtime, args->zeroed ? 0 : HOST_POISON,
+				TRUSTY_RSVD_SIZE + TRUSTY_RUNTIME_TOTAL_SIZE);
+
+		wall = host_now();
+		ret = host_boot_run(trusty_loader_main,
+				(uint64_t *)page(HOST_MBI_PAGE), loader, regs);
+		wall = host_now() - wall;
+
+		if (HOST_BOOT_LINUX != ret)
+			break;
+
+		if (!check_boot(regs)) {
+			host_print("%s: FAILED in round %u, -v shows the loader's log\n",
+					args->image, round);
+			return 1;
+		}
+
+		if (0 == round || wall < best_wall) {
+			best_wall = wall;
+			for (i = 0; i < TL_PHASES; ++i)
+				best[i] = *timeline_get(i);
+		}
+	}
+
+	if ((HOST_BOOT_LINUX != ret) != args->expect_fail) {
+		host_print("%s: FAILED, the loader %s, -v shows its log\n",
+				args->image, HOST_BOOT_LINUX == ret ? "booted Linux" :
+				HOST_BOOT_HALT == ret ? "halted" : "returned");
+		return 1;
+	}
+
+	if (args->expect_fail) {
+		host_print("%s: halted as expected\n", args->image);
+		return 0;
+	}
+
+	host_print("%s: 0x%llx bytes, booted to Linux, best of %u\n",
+			args->image, size, args->rounds);
+	host_report(best, best_wall);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	host_args_t args;
+	const char *end;
+	int i;
+
+	memset(&args, 0, sizeof(args));
+	args.rounds = 1;
+
+	for (i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-v")) {
+			host_console_verbose = 1;
+		} else if (!strcmp(argv[i], "-z")) {
+			args.zeroed = TRUE;
+		} else if (!strcmp(argv[i], "-f")) {
+			args.expect_fail = TRUE;
+		} else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+			args.rounds = str2uint(argv[++i], 10, &end, 10);
+		} else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+			args.args = argv[++i];
+		} else if (!strcmp(argv[i], "-a") && i + 1 < argc) {
+			args.tail = argv[++i];
+		} else if (!strcmp(argv[i], "-e") && i + 1 < argc) {
+			args.loader = argv[++i];
+		} else if ('-' != argv[i][0] && !args.image) {
+			args.image = argv[i];
+		} else {
+			args.image = NULL;
+			break;
+		}
+	}
+
+	if (!args.image || 0 == args.rounds || (uint32_t)-1 == args.rounds) {
+		host_print("usage: %s [-v] [-r ROUNDS] [-z] [-f] [-c ARGS] "
+				"[-a ARGS] [-e LOADER] IMAGE\n", argv[0]);
+		return 2;
+	}
+
+	return run(&args);
+}
@@ -0,0 +1,334 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+/*
+ * Host harness for relocate_elf_image(), "make host-test" and "make
+ * host-bench". elf_ld.c and what it calls (util.c, string.c, sprintf.c,
+ * lz4.c, alternative.c, sha256.c, timeline.c, print.c) are built with the
+ * loader's own flags, host_shim.c stands in for cpu.c and platform.c.
+ *
+ *     host_elf [-v] [-r ROUNDS] [-c REF] [-d DIGEST] [-z] [-f] [-m] [-n]
+ *              IMAGE
+ *
+ * loads IMAGE (ELF, LZ4 image or snapshot) ROUNDS times into an arena at
+ * HOST_ARENA_BASE and reports the fastest round, phase by phase, from the
+ * loader's timeline. The arena is filled with a poison byte before each
+ * round, or zeroed and passed as zeroed memory with -z.
+ *
+ *   -c REF     check the loaded image against the ELF file REF, one made
+ *              by tools/mkelf.py: every word must be as in REF, or moved
+ *              by the load offset if it held its own link address, and
+ *              the bss must be zero
+ *   -d DIGEST  load measured, DIGEST as printed by tools/measure.py
+ *   -f         the load is expected to fail
+ *   -m         segments are expected to be mapped in place, for a loader
+ *              built with TRUSTY_XIP
+ *   -n         HC_REMAP_TRUSTY_PAGES is refused, every segment is expected
+ *              to be copied
+ *   -u         HC_REMAP_TRUSTY_PAGES leaves the pages to the normal world,
+ *              which a measured load must refuse
+ *   -v         show the loader's log
+ */
+#include "trusty_loader_base.h"
+#include "elf_ld.h"
+#include "print.h"
+#include "timeline.h"
+#include "cpu.h"
+#include "util.h"
+#include "string.h"
+
+/* host_shim.c */
+extern int host_console_verbose;
+void host_print(const char *fmt, ...);
+double host_now(void);
+uint64_t host_map(uint64_t base, uint64_t size);
+uint64_t host_read_file(const char *path, uint64_t *size);
+void host_remap_reset(void);
+extern uint64_t host_hypercall_result;
+extern int host_remap_shared;
+
+/* host_report.c */
+void host_report(const timeline_entry_t *phases, double wall);
+
+int strcmp(const char *a, const char *b);
+
+/* 4G, out of the way of the executable, the heap and shared objects. the
+ * image goes HOST_RSVD_SIZE above it, as trusty does above its reserved
+ * page: prelink.py --base 0x100001000 builds snapshots for the harness */
+#define HOST_ARENA_BASE         0x100000000ULL
+#define HOST_RSVD_SIZE          PAGE_4K_SIZE
+#define HOST_ARENA_SIZE         (HOST_RSVD_SIZE + TRUSTY_RUNTIME_TOTAL_SIZE)
+
+#define HOST_POISON             0xA5
+
+typedef struct {
+	const char	*image;
+	const char	*ref;
+	const char	*digest;
+	uint32_t	rounds;
+	boolean_t	zeroed;
+	boolean_t	expect_fail;
+	boolean_t	expect_remap;
+	boolean_t	refuse_remap;
+} host_args_t;
+
+static boolean_t parse_digest(const char *hex, uint8_t *digest)
+{
+	const char *end;
+	char pair[3];
+	uint32_t i;
+
+	for (i = 0; i < SHA256_DIGEST_SIZE; ++i) {
+		pair[0] = hex[i * 2];
+		pair[1] = pair[0] ? hex[i * 2 + 1] : 0;
+		pair[2] = 0;
+		digest[i] = (uint8_t)str2uint(pair, 2, &end, 16);
+		if (end != pair + 2)
+			return FALSE;
+	}
+
+	return 0 == hex[SHA256_DIGEST_SIZE * 2];
+}
+
+static boolean_t mismatch(uint64_t addr, uint64_t link, uint64_t want,
+		uint64_t got)
+{
+	host_print("  mismatch at 0x%llx (link address 0x%llx): expected 0x%llx, "
+			"loaded 0x%llx\n", addr, link, want, got);
+	return FALSE;
+}
+
+/* see -c above. elf64_update_segment_table() moved the program headers,
+ * they are left out */
+static boolean_t check_image(uint64_t ref, uint64_t load_base,
+		uint64_t entry)
+{
+	const elf64_ehdr_t *ehdr = (const elf64_ehdr_t *)ref;
+	const uint8_t *phdrtab = (const uint8_t *)(ref + ehdr->e_phoff);
+	const elf64_phdr_t *phdr;
+	const uint8_t *file, *mem;
+	uint64_t low = (uint64_t)~0;
+	uint64_t offset, skip, i, word, got;
+	uint64_t relocated = 0, bss = 0;
+	uint16_t cnt;
+
+	for (cnt = 0; cnt < ehdr->e_phnum; ++cnt) {
+		phdr = (const elf64_phdr_t *)GET_PHDR(ehdr, phdrtab, cnt);
+		if (PT_LOAD == phdr->p_type && phdr->p_memsz)
+			low = MIN(low, phdr->p_paddr);
+	}
+	offset = load_base - low;
+
+	if (entry != ehdr->e_entry + offset) {
+		host_print("  entry 0x%llx, expected 0x%llx\n", entry,
+				ehdr->e_entry + offset);
+		return FALSE;
+	}
+
+	for (cnt = 0; cnt < ehdr->e_phnum; ++cnt) {
+		phdr = (const elf64_phdr_t *)GET_PHDR(ehdr, phdrtab, cnt);
+		if (PT_LOAD != phdr->p_type || 0 == phdr->p_memsz)
+			continue;
+
+		file = (const uint8_t *)(ref + phdr->p_offset);
+		mem = (const uint8_t *)(phdr->p_paddr + offset);
+		skip = 0;
+		if (0 == phdr->p_offset)
+			skip = ALIGN_F(ehdr->e_phoff +
+					(uint64_t)ehdr->e_phnum * ehdr->e_phentsize, 8ULL);
+
+		for (i = skip; i + 8 <= phdr->p_filesz; i += 8) {
+			word = *(const uint64_t *)(file + i);
+			got = *(const uint64_t *)(mem + i);
+			if (word == phdr->p_paddr + i) {
+				word += offset;
+				relocated++;
+			}
+			if (got != word)
+				return mismatch((uint64_t)(mem + i), phdr->p_paddr + i,
+						word, got);
+		}
+		for (; i < phdr->p_memsz; ++i) {
+			word = (i < phdr->p_filesz) ? file[i] : 0;
+			if (mem[i] != word)
+				return mismatch((uint64_t)(mem + i), phdr->p_paddr + i,
+						word, mem[i]);
+		}
+		bss += phdr->p_memsz - phdr->p_filesz;
+	}
+
+	host_print("  checked: %llu words relocated, 0x%llx bytes bss\n",
+			relocated, bss);
+	return TRUE;
+}
+
+static int run(const host_args_t *args, uint64_t arena)
+{
+	timeline_entry_t best[TL_PHASES];
+	elf_load_info_t info;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	uint64_t image, size;
+	uint64_t ref = 0, ref_size;
+	uint64_t entry = 0;
+	double best_wall = 0, wall;
+	boolean_t ok = FALSE;
+	uint32_t round, i;
+
+	image = host_read_file(args->image, &size);
+	if (!image) {
+		host_print("%s: cannot read it\n", args->image);
+		return 2;
+	}
+
+	if (args->ref) {
+		ref = host_read_file(args->ref, &ref_size);
+		if (!ref) {
+			host_print("%s: cannot read it\n", args->ref);
+			return 2;
+		}
+	}
+
+	if (args->digest && !parse_digest(args->digest, digest)) {
+		host_print("%s: not a SHA-256 digest\n", args->digest);
+		return 2;
+	}
+
+	for (round = 0; round < args->rounds; ++round) {
+		memset(&info, 0, sizeof(info));
+		/* the arena, not the image, gets the poison */
+		host_remap_reset();
+		memset((void *)arena, args->zeroed ? 0 : HOST_POISON,
+				HOST_ARENA_SIZE);
+		if (args->zeroed) {
+			info.zeroed_base = arena + HOST_RSVD_SIZE;
+			info.zeroed_size = TRUSTY_RUNTIME_TOTAL_SIZE;
+		}
+		info.expected_digest = args->digest ? digest : NULL;
+
+		/* drop the last round's log */
+		print_flush();
+
+		timeline_init();
+		wall = host_now();
+		ok = relocate_elf_image(image, size, arena + HOST_RSVD_SIZE, &entry,
+				&info);
+		wall = host_now() - wall;
+
+		if (!ok)
+			break;
+
+		if (0 == round || wall < best_wall) {
+			best_wall = wall;
+			for (i = 0; i < TL_PHASES; ++i)
+				best[i] = *timeline_get(i);
+		}
+	}
+
+	if (ok == args->expect_fail) {
+		host_print("%s: FAILED, the load %s\n", args->image,
+				ok ? "succeeded" : "failed");
+		host_console_verbose = 1;
+		print_flush();
+		return 1;
+	}
+
+	if (!ok) {
+		print_flush();
+		host_print("%s: failed as expected\n", args->image);
+		return 0;
+	}
+
+	host_print("%s: 0x%llx bytes at 0x%llx, %u segments listed, copied 0x%llx, "
+			"remapped 0x%llx, zeroed 0x%llx, skipped 0x%llx, best of %u\n",
+			args->image, size, info.load_base, info.segment_count,
+			info.copied_bytes, info.remapped_bytes, info.zeroed_bytes,
+			info.zero_skipped_bytes, args->rounds);
+	host_report(best, best_wall);
+
+	if ((0 != info.remapped_bytes) != args->expect_remap) {
+		host_print("%s: FAILED, segments %s mapped in place\n",
+				args->image, info.remapped_bytes ? "were" : "were not");
+		return 1;
+	}
+
+	if (ref && !check_image(ref, info.load_base, entry)) {
+		host_print("%s: FAILED the check against %s\n", args->image,
+				args->ref);
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	host_args_t args;
+	uint64_t arena;
+	const char *end;
+	int i;
+
+	memset(&args, 0, sizeof(args));
+	args.rounds = 1;
+
+	for (i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-v")) {
+			host_console_verbose = 1;
+		} else if (!strcmp(argv[i], "-z")) {
+			args.zeroed = TRUE;
+		} else if (!strcmp(argv[i], "-f")) {
+			args.expect_fail = TRUE;
+		} else if (!strcmp(argv[i], "-m")) {
+			args.expect_remap = TRUE;
+		} else if (!strcmp(argv[i], "-n")) {
+			args.refuse_remap = TRUE;
+		} else if (!strcmp(argv[i], "-u")) {
+			host_remap_shared = 1;
+		} else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+			args.rounds = str2uint(argv[++i], 10, &end, 10);
+		} else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+			args.ref = argv[++i];
+		} else if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+			args.digest = argv[++i];
+		} else if ('-' != argv[i][0] && !args.image) {
+			args.image = argv[i];
+		} else {
+			args.image = NULL;
+			break;
+		}
+	}
+
+	if (!args.image || 0 == args.rounds || (uint32_t)-1 == args.rounds) {
+		host_print("usage: %s [-v] [-r ROUNDS] [-c REF] [-d DIGEST] [-z] "
+				"[-f] [-m] [-n] [-u] IMAGE\n", argv[0]);
+		return 2;
+	}
+
+	arena = host_map(HOST_ARENA_BASE, HOST_ARENA_SIZE);
+	if (!arena) {
+		host_print("cannot map 0x%llx bytes at 0x%llx\n",
+				HOST_ARENA_SIZE, HOST_ARENA_BASE);
+		return 2;
+	}
+
+	/* what ACRN returns for a hypercall it does not have */
+	if (args.refuse_remap)
+		host_hypercall_result = (uint64_t)-1;
+
+	util_init(cpu_simd_level());
+	print_init();
+
+	return run(&args, arena);
+}
@@ -0,0 +1,51 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+/*
+ * The timeline of the fastest round, phase by phase, for tools/host_elf.c
+ * and tools/host_boot.c.
+ */
+#include "timeline.h"
+
+/* host_shim.c */
+void host_print(const char *fmt, ...);
+
+void host_report(const timeline_entry_t *phases, double wall)
+{
+	uint64_t khz = timeline_tsc_khz();
+	double us;
+	uint32_t i;
+
+	for (i = TL_ENTRY + 1; i < TL_PHASES; ++i) {
+		if (0 == phases[i].count)
+			continue;
+
+		if (0 == khz) {
+			host_print("  %-10s %12llu cycles  0x%09llx bytes\n",
+					timeline_phase_name(i), phases[i].cycles,
+					phases[i].bytes);
+			continue;
+		}
+
+		us = (double)phases[i].cycles * 1000 / khz;
+		host_print("  %-10s %10.1f us  0x%09llx bytes", timeline_phase_name(i),
+				us, phases[i].bytes);
+		if (phases[i].bytes && us > 0)
+			host_print("  %8.1f MB/s", phases[i].bytes / us);
+		host_print("\n");
+	}
+	host_print("  %-10s %10.1f us\n", "total", wall * 1e6);
+}
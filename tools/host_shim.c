@@ -0,0 +1,458 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+/*
+ * Hosted stand-ins for what the loader sources expect from the machine,
+ * for tools/host_elf.c and tools/host_boot.c:
+ *
+ *   cpu.c       cpuid and rdtsc as they are, features straight from cpuid.
+ *               The host OS already enabled SSE/AVX state, so the SIMD
+ *               level only checks XCR0 and cpu_init() does nothing.
+ *   paging.c    the process keeps its page tables, paging_init() fails
+ *               the way it does when the loader can't build its own
+ *   platform.c  the console is stdout, muted unless host_console_verbose
+ *               is set. "physical memory" is shared anonymous mappings at
+ *               fixed addresses, so prelinked snapshots can be built for
+ *               them; platform_mem() maps what nothing else holds yet.
+ *               each hypercall is recorded with a copy of its parameter,
+ *               the Linux handoff and the halt return to host_boot_run().
+ *               HC_REMAP_TRUSTY_PAGES maps the source pages at the target
+ *               too, as ACRN would in the EPT, unless host_hypercall_result
+ *               refuses it. asked to, it makes the source read-only, as
+ *               taking it from the normal world, and says so, unless
+ *               host_remap_shared is set; host_remap_reset() undoes that.
+ *
+ * This is the only file of the harness that includes libc headers, the
+ * loader headers define their own fixed width types.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* <string.h> would be the loader's string.h, which the harness links */
+void *memcpy(void *dst, const void *src, size_t n);
+void *memset(void *dst, int c, size_t n);
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+/* cpu.h */
+#define CPUID_1_ECX             0
+#define CPUID_1_EDX             1
+#define CPUID_7_EBX             2
+#define CPUID_7_ECX             3
+#define CPUID_7_EDX             4
+#define CPUID_80000001_ECX      5
+#define CPUID_80000001_EDX      6
+
+#define SIMD_NONE               0
+#define SIMD_SSE2               1
+#define SIMD_AVX2               2
+#define SIMD_AVX512             3
+
+#define HOST_REGIONS            16
+#define HOST_HYPERCALLS         8
+#define HOST_HYPERCALL_COPY     512
+#define HOST_REMAPS             64
+
+/* hypercall.h */
+#define HC_REMAP_TRUSTY_PAGES   ((0x80UL << 24) | 0x73UL)
+
+typedef struct {
+	uint64_t src_gpa;
+	uint64_t dst_gpa;
+	uint64_t size;
+	uint32_t flags;
+	uint32_t reserved;
+} trusty_remap_param_t;
+
+#define TRUSTY_REMAP_EXCLUSIVE  0x1
+#define TRUSTY_REMAP_OWNED      0x2
+
+typedef struct {
+	uint64_t id;
+	uint64_t param;
+	uint8_t data[HOST_HYPERCALL_COPY];
+} host_hypercall_t;
+
+/* host_boot_run() results */
+#define HOST_BOOT_RETURNED      0
+#define HOST_BOOT_LINUX         1
+#define HOST_BOOT_HALT          2
+
+int host_console_verbose;
+
+/* what platform_hypercall() returns */
+uint64_t host_hypercall_result;
+
+/* HC_REMAP_TRUSTY_PAGES leaves the source to the normal world */
+int host_remap_shared;
+
+static struct {
+	uint64_t base;
+	uint64_t size;
+} host_regions[HOST_REGIONS];
+static uint32_t host_region_count;
+
+static host_hypercall_t host_hypercalls[HOST_HYPERCALLS];
+static uint32_t host_hypercall_count;
+
+static struct {
+	uint64_t src;
+	uint64_t dst;
+	uint64_t size;
+} host_remaps[HOST_REMAPS];
+static uint32_t host_remap_count;
+
+static uint64_t host_linux_regs[6];
+static jmp_buf host_boot_exit;
+
+void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx,
+		uint32_t *ecx, uint32_t *edx)
+{
+	__asm__ __volatile__ ("cpuid"
+			: "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+			: "a" (leaf), "c" (subleaf));
+}
+
+uint64_t rdtsc(void)
+{
+	uint32_t lo, hi;
+
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi) :: "memory");
+	return ((uint64_t)hi << 32) | lo;
+}
+
+int cpu_has_feature(uint32_t feature)
+{
+	uint32_t r[4];
+	uint32_t max_leaf;
+
+	cpuid(0, 0, &max_leaf, &r[1], &r[2], &r[3]);
+
+	switch (feature / 32) {
+	case CPUID_1_ECX:
+	case CPUID_1_EDX:
+		cpuid(1, 0, &r[0], &r[1], &r[2], &r[3]);
+		return (r[feature / 32 == CPUID_1_ECX ? 2 : 3] >> (feature % 32)) & 1;
+	case CPUID_7_EBX:
+	case CPUID_7_ECX:
+	case CPUID_7_EDX:
+		if (max_leaf < 7)
+			return 0;
+		cpuid(7, 0, &r[0], &r[1], &r[2], &r[3]);
+		return (r[feature / 32 - CPUID_7_EBX + 1] >> (feature % 32)) & 1;
+	case CPUID_80000001_ECX:
+	case CPUID_80000001_EDX:
+		cpuid(0x80000001, 0, &r[0], &r[1], &r[2], &r[3]);
+		return (r[feature / 32 == CPUID_80000001_ECX ? 2 : 3] >>
+				(feature % 32)) & 1;
+	default:
+		return 0;
+	}
+}
+
+uint32_t cpu_simd_level(void)
+{
+	uint32_t eax, ebx, ecx, edx;
+	uint32_t lo, hi;
+	uint64_t xcr0;
+
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	if (!(ecx & (1U << 27)))                /* OSXSAVE */
+		return SIMD_SSE2;
+
+	__asm__ __volatile__ ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+	xcr0 = ((uint64_t)hi << 32) | lo;
+
+	cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+	if ((ebx & (1U << 16)) && (xcr0 & 0xE6) == 0xE6)
+		return SIMD_AVX512;
+	if ((ebx & (1U << 5)) && (xcr0 & 0x6) == 0x6)
+		return SIMD_AVX2;
+	return SIMD_SSE2;
+}
+
+void cpu_init(void)
+{
+}
+
+void cpu_restore(void)
+{
+}
+
+void paging_report(const char *name, uint64_t addr)
+{
+	(void)name;
+	(void)addr;
+}
+
+uint32_t paging_init(uint64_t runtime_base, uint64_t runtime_size)
+{
+	(void)runtime_base;
+	(void)runtime_size;
+	return 0;
+}
+
+void paging_enter(void)
+{
+}
+
+void paging_leave(void)
+{
+}
+
+/* the pages at src also at dst, both shared mappings. the loader copies
+ * the segment when this fails */
+static uint64_t host_remap(trusty_remap_param_t *param)
+{
+	void *p;
+
+	if (((param->src_gpa | param->dst_gpa | param->size) & 0xFFF) ||
+			0 == param->size || HOST_REMAPS == host_remap_count)
+		return (uint64_t)-1;
+
+	/* an old size of 0 duplicates a shared mapping instead of moving it */
+	p = mremap((void *)param->src_gpa, 0, param->size,
+			MREMAP_MAYMOVE | MREMAP_FIXED, (void *)param->dst_gpa);
+	if (MAP_FAILED == p)
+		return (uint64_t)-1;
+
+	host_remaps[host_remap_count].src = param->src_gpa;
+	host_remaps[host_remap_count].dst = param->dst_gpa;
+	host_remaps[host_remap_count].size = param->size;
+	host_remap_count++;
+
+	param->flags &= ~TRUSTY_REMAP_OWNED;
+	if ((param->flags & TRUSTY_REMAP_EXCLUSIVE) && !host_remap_shared &&
+			0 == mprotect((void *)param->src_gpa, param->size, PROT_READ))
+		param->flags |= TRUSTY_REMAP_OWNED;
+	return 0;
+}
+
+/* fresh memory where HC_REMAP_TRUSTY_PAGES mapped the package, so that
+ * the next load does not write through to it, and the package writable
+ * again */
+void host_remap_reset(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < host_remap_count; ++i) {
+		mmap((void *)host_remaps[i].dst, host_remaps[i].size,
+				PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+		mprotect((void *)host_remaps[i].src, host_remaps[i].size,
+				PROT_READ | PROT_WRITE);
+	}
+	host_remap_count = 0;
+}
+
+uint64_t platform_hypercall(uint64_t id, uint64_t param)
+{
+	host_hypercall_t *call;
+
+	if (host_hypercall_count < HOST_HYPERCALLS) {
+		call = &host_hypercalls[host_hypercall_count];
+		call->id = id;
+		call->param = param;
+		/* the parameters live on the loader's stack, gone by the time
+		 * the harness looks */
+		memcpy(call->data, (const void *)param, HOST_HYPERCALL_COPY);
+	}
+	host_hypercall_count++;
+
+	if ((HC_REMAP_TRUSTY_PAGES == id) && (0 == host_hypercall_result))
+		return host_remap((trusty_remap_param_t *)param);
+
+	return host_hypercall_result;
+}
+
+uint32_t platform_console_init(void)
+{
+	return 0;
+}
+
+void platform_console_write(const char *buf, uint64_t size)
+{
+	if (host_console_verbose)
+		fwrite(buf, 1, size, stdout);
+}
+
+static int host_region_add(uint64_t base, uint64_t size)
+{
+	if (host_region_count == HOST_REGIONS)
+		return 0;
+
+	host_regions[host_region_count].base = base;
+	host_regions[host_region_count].size = size;
+	host_region_count++;
+	return 1;
+}
+
+/* size bytes of memory at base, 0 if the address is taken */
+uint64_t host_map(uint64_t base, uint64_t size)
+{
+	void *p;
+
+	if (host_region_count == HOST_REGIONS)
+		return 0;
+
+	p = mmap((void *)base, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if (MAP_FAILED == p)
+		return 0;
+	if ((uint64_t)p != base) {
+		/* kernels before 4.17 take the flag as a hint */
+		munmap(p, size);
+		return 0;
+	}
+
+	host_region_add(base, size);
+	return base;
+}
+
+void *platform_mem(uint64_t addr, uint64_t size)
+{
+	uint64_t page = addr & ~0xFFFULL;
+	uint32_t i;
+
+	for (i = 0; i < host_region_count; ++i) {
+		if (addr >= host_regions[i].base &&
+				addr + size <= host_regions[i].base + host_regions[i].size)
+			return (void *)addr;
+	}
+
+	/* RAM nobody put anything in yet */
+	if (0 == page || !host_map(page, ((addr + size + 0xFFF) & ~0xFFFULL) - page))
+		return NULL;
+	return (void *)addr;
+}
+
+void platform_launch_linux(uint64_t rip, uint64_t rax, uint64_t rbx,
+		uint64_t rsi, uint64_t rdi, uint64_t rcx)
+{
+	host_linux_regs[0] = rip;
+	host_linux_regs[1] = rax;
+	host_linux_regs[2] = rbx;
+	host_linux_regs[3] = rsi;
+	host_linux_regs[4] = rdi;
+	host_linux_regs[5] = rcx;
+	longjmp(host_boot_exit, HOST_BOOT_LINUX);
+}
+
+void platform_halt(void)
+{
+	longjmp(host_boot_exit, HOST_BOOT_HALT);
+}
+
+/* entry(mbi, loader_base) as trusty_loader_entry.S calls it, with the
+ * hypercall record cleared. HOST_BOOT_LINUX if it handed off to Linux,
+ * regs then holds rip, rax, rbx, rsi, rdi and rcx, HOST_BOOT_HALT if it
+ * gave up.
+ */
+int host_boot_run(void (*entry)(uint64_t *, uint64_t), uint64_t *mbi,
+		uint64_t loader_base, uint64_t *regs)
+{
+	int ret;
+
+	host_hypercall_count = 0;
+	host_remap_reset();
+	memset(host_linux_regs, 0, sizeof(host_linux_regs));
+
+	ret = setjmp(host_boot_exit);
+	if (0 == ret) {
+		entry(mbi, loader_base);
+		return HOST_BOOT_RETURNED;
+	}
+
+	memcpy(regs, host_linux_regs, sizeof(host_linux_regs));
+	return ret;
+}
+
+/* hypercall i of the last host_boot_run(), NULL past the last one */
+const void *host_hypercall(uint32_t i, uint64_t *id)
+{
+	if (i >= host_hypercall_count || i >= HOST_HYPERCALLS)
+		return NULL;
+
+	*id = host_hypercalls[i].id;
+	return host_hypercalls[i].data;
+}
+
+/* the harness' own output, the loader's printf() goes to the log ring */
+void host_print(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf(stdout, fmt, args);
+	va_end(args);
+}
+
+double host_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the file in page aligned memory, like vSBL leaves a multiboot module */
+uint64_t host_read_file(const char *path, uint64_t *size)
+{
+	struct stat st;
+	uint8_t *p;
+	ssize_t n;
+	uint64_t done = 0;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st) || 0 == st.st_size) {
+		if (fd >= 0)
+			close(fd);
+		return 0;
+	}
+
+	p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == p) {
+		close(fd);
+		return 0;
+	}
+
+	while (done < (uint64_t)st.st_size) {
+		n = read(fd, p + done, st.st_size - done);
+		if (n <= 0)
+			break;
+		done += n;
+	}
+	close(fd);
+
+	if (done != (uint64_t)st.st_size) {
+		munmap(p, st.st_size);
+		return 0;
+	}
+
+	*size = done;
+	return (uint64_t)p;
+}
@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+################################################################################
+# Copyright (c) 2018 Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+################################################################################
+
+"""Turn the tokenized log of a -DLOG_TOKENS loader back into text.
+
+The loader sends, for each printf(), LOG_TOKEN_SYNC, the offset of the
+format string in its .logfmt section and the arguments (see print.h for
+the record).
+make saves that section as out/trusty_loader.logfmt. Everything outside a
+record, like the output of trusty or Linux on the same UART, is passed
+through as it is.
+
+    python3 tools/logdecode.py out/trusty_loader.logfmt < uart.log
+"""
+
+import argparse
+import re
+import sys
+
+LOG_TOKEN_SYNC = 0x1E
+
+# what vmm_vsprintf_s() parses after a '%': a width, '0' first for zero
+# padding, 'l's and the conversion, see sprintf.c. anything else prints
+# the '%' as it is.
+CONVERSION = re.compile(rb'%(\d*)(l*)(.?)', re.S)
+
+
+class Truncated(Exception):
+    pass
+
+
+def varint(data, pos):
+    value = shift = 0
+    while True:
+        if pos >= len(data):
+            raise Truncated()
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7f) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def number(value, width, zero, long, signed=False, base=10, upper=False):
+    """ull2str() in sprintf.c: the sign comes first and counts towards the
+    width, the digits are padded on the left."""
+    if not long:
+        value &= 0xffffffff
+    sign = ''
+    bits = 64 if long else 32
+    if signed and value >> (bits - 1):
+        sign, value = '-', (1 << bits) - value
+    digits = ('%X' if upper else '%x') % value if base == 16 else str(value)
+    pad = max(0, width - len(sign) - len(digits))
+    return sign + ('0' if zero else ' ') * pad + digits
+
+
+def arguments(data, pos):
+    """The arguments of the record at data[pos], integers or for %s bytes,
+    and the position after them."""
+    info, pos = varint(data, pos)
+    strings, count = info >> 4, info & 0xf
+    args = []
+    for i in range(count):
+        value, pos = varint(data, pos)
+        if strings & (1 << i):
+            if pos + value > len(data):
+                raise Truncated()
+            args.append(data[pos:pos + value])
+            pos += value
+        else:
+            args.append(value)
+    return args, pos
+
+
+def format_record(fmt, args):
+    """vmm_vsprintf_s() of fmt with the logged args."""
+    out = ''
+    last = 0
+    args = iter(args)
+    for m in CONVERSION.finditer(fmt):
+        out += fmt[last:m.start()].decode('latin-1')
+        last = m.end()
+        width, length, conv = m.groups()
+        zero = width.startswith(b'0')
+        width = int(width or b'0')
+        long = bool(length)
+        conv = conv.decode('latin-1')
+
+        if conv == '%':
+            out += '%'
+            continue
+        if conv not in 'scduxXpP':
+            # printed as is from the '%' on
+            out += '%'
+            last = m.start() + 1
+            continue
+
+        value = next(args, None)
+        if conv == 's':
+            if not isinstance(value, bytes):
+                value = b'<missing string>'
+            text = value.decode('latin-1')
+            out += text[:width].ljust(width) if width else text
+            continue
+        if not isinstance(value, int):
+            value = 0
+        if conv == 'c':
+            out += chr(value & 0xff)
+        elif conv in 'du':
+            out += number(value, width, zero, long, signed=conv == 'd')
+        elif conv in 'xX':
+            out += number(value, width, zero, long, base=16,
+                          upper=conv == 'X')
+        else:
+            out += '0x' + number(value, max(width, 10) - 2, True, True,
+                                 base=16, upper=conv == 'P')
+
+    out += fmt[last:].decode('latin-1')
+    # vmm_vsprintf_s() puts a CR before each LF
+    return out.replace('\n', '\r\n').encode('latin-1')
+
+
+def decode(formats, data):
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        sync = data.find(bytes([LOG_TOKEN_SYNC]), pos)
+        if sync < 0:
+            out += data[pos:]
+            break
+        out += data[pos:sync]
+        try:
+            offset, pos = varint(data, sync + 1)
+            if offset >= len(formats):
+                raise ValueError('format offset 0x%x' % offset)
+            fmt = formats[offset:formats.index(b'\0', offset)]
+            args, pos = arguments(data, pos)
+            text = format_record(fmt, args)
+        except Truncated:
+            out += b'<truncated record>\r\n'
+            break
+        except ValueError as e:
+            out += ('<bad record: %s>\r\n' % e).encode()
+            pos = sync + 1
+            continue
+        out += text
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('formats', help='trusty_loader.logfmt')
+    parser.add_argument('log', nargs='?', help='UART capture, default stdin')
+    args = parser.parse_args()
+
+    with open(args.formats, 'rb') as f:
+        formats = f.read()
+    if args.log:
+        with open(args.log, 'rb') as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    sys.stdout.buffer.write(decode(formats, data))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+################################################################################
+# Copyright (c) 2018 Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+################################################################################
+
+"""Pack lk.elf into the LZ4 image format understood by relocate_elf_image().
+
+Layout (see elf_lz4_hdr_t / elf_lz4_block_t in elf_ld.h):
+
+    elf_lz4_hdr_t
+    elf_lz4_block_t[block_count]
+    ELF, program and section headers + section names, uncompressed
+    block data
+
+Only the file contents of PT_LOAD segments are kept. They are cut into
+independent LZ4 blocks that never straddle a segment, so the loader can
+decompress each one straight to its runtime address. Blocks that do not
+shrink are stored as they are.
+"""
+
+import argparse
+import struct
+import sys
+
+from elfimage import ElfImage
+
+ELF_LZ4_MAGIC = 0x345a4c54      # "TLZ4"
+ELF_LZ4_VERSION = 1
+
+LZ4_HDR = struct.Struct('<IIIIQQ')
+LZ4_BLOCK = struct.Struct('<QQII')
+
+E_SHOFF = 0x28                  # offset of e_shoff in the ELF header
+
+DEFAULT_BLOCK_SIZE = 64 * 1024
+
+MIN_MATCH = 4
+LAST_LITERALS = 5
+MF_LIMIT = 12
+MAX_OFFSET = 65535
+
+
+def _length_bytes(n):
+    out = bytearray()
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+    return out
+
+
+def _sequence(out, literals, match_len):
+    lit_len = len(literals)
+    token = (min(lit_len, 15) << 4)
+    if match_len is not None:
+        token |= min(match_len - MIN_MATCH, 15)
+    out.append(token)
+    if lit_len >= 15:
+        out += _length_bytes(lit_len - 15)
+    out += literals
+
+
+def compress_block(data):
+    """Greedy LZ4 block compressor, used when python-lz4 is missing."""
+    try:
+        import lz4.block
+        return lz4.block.compress(bytes(data), mode='high_compression',
+                                  store_size=False)
+    except ImportError:
+        pass
+
+    n = len(data)
+    out = bytearray()
+    table = {}
+    anchor = 0
+    pos = 0
+    limit = n - MF_LIMIT
+    while pos < limit:
+        key = data[pos:pos + 4]
+        cand = table.get(key)
+        table[key] = pos
+        if cand is None or pos - cand > MAX_OFFSET:
+            pos += 1
+            continue
+        length = 4
+        max_len = n - LAST_LITERALS - pos
+        while length < max_len and data[cand + length] == data[pos + length]:
+            length += 1
+        _sequence(out, data[anchor:pos], length)
+        offset = pos - cand
+        out += struct.pack('<H', offset)
+        if length - MIN_MATCH >= 15:
+            out += _length_bytes(length - MIN_MATCH - 15)
+        pos += length
+        anchor = pos
+    _sequence(out, data[anchor:], None)
+    return bytes(out)
+
+
+def decompress_block(data, raw_size):
+    """Inverse of compress_block(), for tools that read LZ4 images."""
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        token = data[pos]
+        pos += 1
+        lit_len = token >> 4
+        if lit_len == 15:
+            while True:
+                lit_len += data[pos]
+                pos += 1
+                if data[pos - 1] != 255:
+                    break
+        out += data[pos:pos + lit_len]
+        pos += lit_len
+        if pos >= len(data):
+            break
+        offset = data[pos] | data[pos + 1] << 8
+        pos += 2
+        match_len = token & 15
+        if match_len == 15:
+            while True:
+                match_len += data[pos]
+                pos += 1
+                if data[pos - 1] != 255:
+                    break
+        match_len += MIN_MATCH
+        if not 0 < offset <= len(out):
+            raise ValueError('lz4 match offset %d out of range' % offset)
+        for _ in range(match_len):
+            out.append(out[-offset])
+    if len(out) != raw_size:
+        raise ValueError('lz4 block holds %d bytes, %d expected'
+                         % (len(out), raw_size))
+    return bytes(out)
+
+
+def pack(elf, block_size):
+    blocks = []
+    for p in elf.loads():
+        for off in range(p.p_offset, p.p_offset + p.p_filesz, block_size):
+            raw = bytes(elf.data[off:min(off + block_size,
+                                         p.p_offset + p.p_filesz)])
+            comp = compress_block(raw)
+            if len(comp) >= len(raw):
+                comp = raw
+            blocks.append((off, raw, comp))
+
+    # keep the section headers too, the loader looks up .altinstructions
+    prefix = bytearray(elf.data[:elf.header_size()])
+    prefix += bytes(-len(prefix) % 8)
+    shdrs, shoff = elf.section_headers_blob(len(prefix))
+    struct.pack_into('<Q', prefix, E_SHOFF, shoff)
+    prefix += shdrs
+    prefix_offset = LZ4_HDR.size + LZ4_BLOCK.size * len(blocks)
+    data_offset = prefix_offset + len(prefix)
+
+    table = bytearray()
+    payload = bytearray()
+    for off, raw, comp in blocks:
+        table += LZ4_BLOCK.pack(off, data_offset + len(payload),
+                                len(raw), len(comp))
+        payload += comp
+
+    hdr = LZ4_HDR.pack(ELF_LZ4_MAGIC, ELF_LZ4_VERSION, len(blocks), 0,
+                       prefix_offset, len(prefix))
+    return hdr + table + bytes(prefix) + payload
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('input', help='trusty ELF image (lk.elf)')
+    parser.add_argument('output', help='LZ4 image to write')
+    parser.add_argument('--block-size', type=int, default=DEFAULT_BLOCK_SIZE,
+                        help='uncompressed bytes per block (default 64K)')
+    args = parser.parse_args()
+
+    elf = ElfImage.from_file(args.input)
+    image = pack(elf, args.block_size)
+    with open(args.output, 'wb') as f:
+        f.write(image)
+
+    loaded = sum(p.p_filesz for p in elf.loads())
+    print('%s: %d bytes of segment data packed into %d bytes'
+          % (args.output, loaded, len(image)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
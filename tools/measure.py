@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+################################################################################
+# Copyright (c) 2018 Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+################################################################################
+
+"""Compute the SHA-256 measurement relocate_elf_image() checks.
+
+ELF file or LZ4 image: SHA-256 over
+
+    the ELF header, e_shoff/e_shentsize/e_shnum/e_shstrndx cleared
+    the program header table
+    for each PT_LOAD segment, in program header order, its file contents
+    and the size of its bss, p_memsz past them, as a 64 bit little endian
+    number
+
+which is what the loader sees once the segments are in place, before
+alternatives or relocations touch them. lz4pack.py only moves the
+section headers, so lk.elf and lk.lz4 measure the same.
+
+Runtime snapshot: SHA-256 of elf_snapshot_hdr_t, which carries the
+digests of the prelinked data and of the fallback image.
+
+With --patch the digest is written into trusty_loader.bin, the loader then
+refuses to start an image that does not match it.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+from elfimage import ElfImage, EHDR
+from lz4pack import (ELF_LZ4_MAGIC, LZ4_HDR, LZ4_BLOCK, decompress_block)
+
+ELF_SNAP_MAGIC = 0x504e5354     # "TSNP"
+
+# elf_snapshot_hdr_t, see elf_ld.h
+SNAP_HDR = struct.Struct('<IIQQQQQQQQQ32s32s')
+
+# trusty_image_digest in trusty_loader_entry.S: the 32 byte multiboot
+# header, then the 4 byte trusty_pkg_offset
+LOADER_DIGEST_OFFSET = 36
+
+
+def measure_elf(elf, segment_data=None):
+    """segment_data(phdr, filesz) returns the file contents of a PT_LOAD
+    segment, by default they are read from the ELF file itself."""
+    fields = dict(zip(ElfImage.FIELDS, EHDR.unpack_from(elf.data)))
+    for name in ('e_shoff', 'e_shentsize', 'e_shnum', 'e_shstrndx'):
+        fields[name] = 0
+
+    h = hashlib.sha256()
+    h.update(EHDR.pack(*[fields[name] for name in ElfImage.FIELDS]))
+    h.update(elf.data[elf.e_phoff:elf.e_phoff + elf.e_phnum * elf.e_phentsize])
+    for p in elf.loads():
+        filesz = min(p.p_filesz, p.p_memsz)
+        if segment_data:
+            h.update(segment_data(p, filesz))
+        else:
+            h.update(elf.data[p.p_offset:p.p_offset + filesz])
+        h.update(struct.pack('<Q', p.p_memsz - filesz))
+    return h.digest()
+
+
+def measure_lz4(data):
+    _, _, block_count, _, prefix_offset, prefix_size = \
+        LZ4_HDR.unpack_from(data)
+    elf = ElfImage(data[prefix_offset:prefix_offset + prefix_size])
+    blocks = [LZ4_BLOCK.unpack_from(data, LZ4_HDR.size + i * LZ4_BLOCK.size)
+              for i in range(block_count)]
+
+    def segment_data(p, filesz):
+        out = bytearray(filesz)
+        for file_offset, data_offset, raw_size, comp_size in blocks:
+            if not p.p_offset <= file_offset < p.p_offset + filesz:
+                continue
+            comp = data[data_offset:data_offset + comp_size]
+            raw = comp if comp_size == raw_size else \
+                decompress_block(comp, raw_size)
+            start = file_offset - p.p_offset
+            out[start:start + raw_size] = raw
+        return bytes(out)
+
+    return measure_elf(elf, segment_data)
+
+
+def measure(data):
+    magic = struct.unpack_from('<I', data)[0]
+    if magic == ELF_SNAP_MAGIC:
+        return hashlib.sha256(data[:SNAP_HDR.size]).digest()
+    if magic == ELF_LZ4_MAGIC:
+        return measure_lz4(data)
+    return measure_elf(ElfImage(data))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('image', help='lk.elf, lk.lz4 or lk.snap')
+    parser.add_argument('--patch', metavar='LOADER',
+                        help='store the digest in trusty_loader.bin')
+    args = parser.parse_args()
+
+    with open(args.image, 'rb') as f:
+        digest = measure(f.read())
+
+    if args.patch:
+        with open(args.patch, 'r+b') as f:
+            f.seek(LOADER_DIGEST_OFFSET)
+            f.write(digest)
+
+    print('%s: sha256 %s' % (args.image, digest.hex()))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
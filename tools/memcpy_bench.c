@@ -0,0 +1,529 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+/*
+ * Host check and benchmark of the loader's memcpy() and memmove(), "make
+ * memcpy_bench". util.c is built with the loader's flags and replaces the
+ * C library's functions in this process, the C library's own are taken
+ * with dlsym(RTLD_NEXT) as the reference.
+ *
+ * For every SIMD level the host CPU has, util_init() selects its kernels
+ * and both functions are checked against the C library: every size up to
+ * past each size class of util.c (COPY_SMALL_SIZE, SIMD_MIN_SIZE) and a
+ * few large ones, at source and destination alignments across a cache
+ * line, and memmove() over ranges overlapping by 1 byte to all of them in
+ * both directions, the backward copy included. The bytes around the
+ * destination must be left alone.
+ *
+ * Then the size classes are timed, aligned and not, memmove() forward
+ * and backward over half overlapping ranges, with the best kernels, the
+ * scalar code the loader runs before cpu_init() and the C library. -c
+ * stops after the checks, "make host-test" runs it that way.
+ *
+ * With -s memcpy() and memset() are timed against memcpy_stream() and
+ * memset_stream() instead, from 256K to 64 MB, with the time
+ * to read a 1 MB hot set back after each, which stands for the package,
+ * boot params and loader data the streaming stores are there to keep in
+ * the cache. Where perf counters can be read, the last level cache
+ * misses of both are counted too. util.c is built for this bench with
+ * STREAM_MIN_SIZE 1, so the streaming functions stream at every size; the
+ * size from which they are faster is what STREAM_MIN_SIZE should be.
+ *
+ * The loader headers define their own fixed width types, so no libc
+ * header that defines them can be included here.
+ */
+#include <time.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "trusty_loader_base.h"
+#include "cpu.h"
+#include "util.h"
+
+int printf(const char *fmt, ...);
+int memcmp(const void *a, const void *b, unsigned long size);
+int posix_memalign(void **ptr, unsigned long align, unsigned long size);
+int strcmp(const char *a, const char *b);
+void *dlsym(void *handle, const char *name);
+
+#define RTLD_NEXT       ((void *)-1L)
+
+typedef void *(*libc_copy_t)(void *dest, const void *src, unsigned long n);
+
+/* the largest size checked, and the largest timed */
+#define CHECK_MAX       (64 KILOBYTE + 13)
+#define BENCH_MAX       (16 MEGABYTE)
+/* guard bytes around each destination, and alignment play */
+#define GUARD           128
+#define BUF_SIZE        (2 * BENCH_MAX + 4 * GUARD)
+#define BENCH_BYTES     (64 MEGABYTE)       /* copied per timing run */
+#define BENCH_ROUNDS    5
+/* -s, streaming against cached stores */
+#define STREAM_MAX      (64 MEGABYTE)
+#define HOT_SIZE        (1 MEGABYTE)
+#define NO_COUNT        (~0ULL)
+
+static libc_copy_t libc_memcpy;
+static libc_copy_t libc_memmove;
+
+static uint8_t *buf;
+static uint8_t *ref;
+
+static uint64_t xorshift_state = 0x2545F4914F6CDD1DULL;
+
+static uint64_t xorshift(void)
+{
+	xorshift_state ^= xorshift_state << 13;
+	xorshift_state ^= xorshift_state >> 7;
+	xorshift_state ^= xorshift_state << 17;
+	return xorshift_state;
+}
+
+/* random bytes, so a byte copied from the wrong place shows */
+static void fill(uint8_t *p, uint64_t size)
+{
+	uint64_t i;
+
+	for (i = 0; i < size; ++i)
+		p[i] = (uint8_t)xorshift();
+}
+
+void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx,
+		uint32_t *ecx, uint32_t *edx)
+{
+	__asm__ __volatile__ ("cpuid"
+			: "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+			: "a" (leaf), "c" (subleaf));
+}
+
+/* the highest SIMD_* level the host CPU and OS have, as cpu.c finds it */
+static uint32_t host_simd_level(void)
+{
+	uint32_t r[4];
+	uint32_t lo, hi;
+	uint64_t xcr0;
+	uint32_t ebx7 = 0;
+
+	cpuid(0, 0, &r[0], &r[1], &r[2], &r[3]);
+	if (r[0] >= 7) {
+		cpuid(7, 0, &r[0], &r[1], &r[2], &r[3]);
+		ebx7 = r[1];
+	}
+
+	cpuid(1, 0, &r[0], &r[1], &r[2], &r[3]);
+	if (!(r[2] & (1U << 27)))       /* OSXSAVE */
+		return SIMD_SSE2;
+
+	__asm__ __volatile__ ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+	xcr0 = ((uint64_t)hi << 32) | lo;
+
+	if (((xcr0 & 0xE6) == 0xE6) && (ebx7 & (1U << 16)))
+		return SIMD_AVX512;
+	if (((xcr0 & 0x06) == 0x06) && (ebx7 & (1U << 5)))
+		return SIMD_AVX2;
+	return SIMD_SSE2;
+}
+
+static const char *simd_name(uint32_t level)
+{
+	switch (level) {
+	case SIMD_AVX512:
+		return "avx512";
+	case SIMD_AVX2:
+		return "avx2";
+	case SIMD_SSE2:
+		return "sse2";
+	default:
+		return "scalar";
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* every size to past SIMD_MIN_SIZE, then around the powers of 2 */
+static uint64_t check_size(uint32_t i)
+{
+	static const uint64_t large[] = {
+		1023, 1024, 1025, 4095, 4096, 4097, 65535, 65536, CHECK_MAX,
+	};
+
+	if (i <= 520)
+		return i;
+	i -= 521;
+	return (i < sizeof(large) / sizeof(large[0])) ? large[i] : 0;
+}
+
+static const uint32_t offsets[] = { 0, 1, 3, 8, 15, 16, 31, 32, 33, 63 };
+#define OFFSETS         (sizeof(offsets) / sizeof(offsets[0]))
+
+/* memcpy() from src + soff to dest + doff, the same done by the C library
+ * on ref, then the two destinations compared guard bytes and all */
+static boolean_t check_memcpy(void)
+{
+	uint8_t *src = buf + BENCH_MAX + 2 * GUARD;
+	uint64_t size;
+	uint32_t i, s, d;
+
+	fill(src, CHECK_MAX + GUARD);
+
+	for (i = 0; (size = check_size(i)) || (0 == i); ++i) {
+		for (s = 0; s < OFFSETS; ++s) {
+			for (d = 0; d < OFFSETS; ++d) {
+				fill(buf, size + 2 * GUARD);
+				libc_memcpy(ref, buf, size + 2 * GUARD);
+
+				memcpy(buf + GUARD + offsets[d], src + offsets[s],
+						size);
+				libc_memcpy(ref + GUARD + offsets[d],
+						src + offsets[s], size);
+
+				if (memcmp(buf, ref, size + 2 * GUARD)) {
+					printf("memcpy: size %llu src +%u dest +%u "
+							"differs\n", size, offsets[s],
+							offsets[d]);
+					return FALSE;
+				}
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+/* memmove() within one buffer, dest delta bytes after src (backward) or
+ * before it (forward), from overlapping by all but a byte to not at all */
+static boolean_t check_memmove(void)
+{
+	uint64_t size, delta, span;
+	uint64_t src, dest;
+	uint32_t i, o, dir;
+
+	for (i = 0; (size = check_size(i)) || (0 == i); ++i) {
+		for (delta = 1; delta <= size + 1;
+				delta += (delta < 70) ? 1 : (size / 7 + 1)) {
+			for (o = 0; o < OFFSETS; o += 3) {
+				for (dir = 0; dir < 2; ++dir) {
+					span = size + delta + 2 * GUARD;
+					src = GUARD + offsets[o] + (dir ? 0 : delta);
+					dest = dir ? (src + delta) : (src - delta);
+
+					fill(buf, span);
+					libc_memcpy(ref, buf, span);
+					memmove(buf + dest, buf + src, size);
+					libc_memmove(ref + dest, ref + src, size);
+
+					if (memcmp(buf, ref, span)) {
+						printf("memmove: size %llu %s by %llu "
+								"at +%u differs\n", size,
+								dir ? "backward" : "forward",
+								delta, offsets[o]);
+						return FALSE;
+					}
+				}
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+typedef enum {
+	COPY,
+	MOVE_FORWARD,
+	MOVE_BACKWARD,
+} bench_op_t;
+
+/* bytes per second of op on size bytes, best of BENCH_ROUNDS */
+static double bench(bench_op_t op, boolean_t use_libc, uint64_t size,
+		uint32_t misalign)
+{
+	uint64_t calls = BENCH_BYTES / size;
+	uint8_t *src, *dest;
+	double best = 0, start, t;
+	uint64_t i;
+	uint32_t round;
+
+	/* half overlapping for memmove(), apart for memcpy() */
+	switch (op) {
+	case MOVE_FORWARD:
+		dest = buf + GUARD + misalign;
+		src = dest + size / 2;
+		break;
+	case MOVE_BACKWARD:
+		src = buf + GUARD + misalign;
+		dest = src + size / 2;
+		break;
+	default:
+		src = buf + GUARD + 3 * misalign;
+		dest = buf + BENCH_MAX + 2 * GUARD + misalign;
+		break;
+	}
+
+	if (calls > 1000000)
+		calls = 1000000;
+
+	for (round = 0; round < BENCH_ROUNDS; ++round) {
+		start = now();
+		for (i = 0; i < calls; ++i) {
+			if (COPY == op) {
+				if (use_libc)
+					libc_memcpy(dest, src, size);
+				else
+					memcpy(dest, src, size);
+			} else {
+				if (use_libc)
+					libc_memmove(dest, src, size);
+				else
+					memmove(dest, src, size);
+			}
+		}
+		t = now() - start;
+		if (0 == round || t < best)
+			best = t;
+	}
+
+	return (double)calls * size / best;
+}
+
+static void bench_row(bench_op_t op, uint32_t level, uint64_t size,
+		uint32_t misalign)
+{
+	static const char *names[] = {
+		"memcpy", "memmove fwd", "memmove bwd",
+	};
+	double best, scalar, libc;
+
+	util_init(level);
+	best = bench(op, FALSE, size, misalign);
+	util_init(SIMD_NONE);
+	scalar = bench(op, FALSE, size, misalign);
+	libc = bench(op, TRUE, size, misalign);
+
+	printf("%-12s %9llu %-9s %9.2f %9.2f %9.2f\n", names[op], size,
+			misalign ? "unaligned" : "aligned", best / 1e9,
+			scalar / 1e9, libc / 1e9);
+}
+
+/* a last level cache miss counter on this process, -1 without one */
+static int perf_open(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void perf_start(int fd)
+{
+	if (fd >= 0) {
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+static uint64_t perf_stop(int fd)
+{
+	uint64_t count;
+
+	if (fd < 0)
+		return NO_COUNT;
+
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	if (read(fd, &count, sizeof(count)) != sizeof(count))
+		return NO_COUNT;
+	return count;
+}
+
+static void print_count(uint64_t count)
+{
+	if (NO_COUNT == count)
+		printf(" %10s", "-");
+	else
+		printf(" %10llu", count);
+}
+
+/* a line of each 64 bytes of the hot set */
+static uint64_t read_hot(const uint8_t *hot)
+{
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < HOT_SIZE; i += 64)
+		sum += *(const volatile uint8_t *)(hot + i);
+	return sum;
+}
+
+static void stream_row(uint32_t op, uint8_t *dest, const uint8_t *src,
+		const uint8_t *hot, uint64_t size, int fd)
+{
+	static const char *names[] = {
+		"memcpy", "memcpy_stream", "memset", "memset_stream",
+	};
+	double best = 0, hot_time = 0, start, t;
+	uint64_t misses = NO_COUNT, hot_misses = NO_COUNT;
+	uint64_t op_count, hot_count;
+	uint32_t round;
+
+	for (round = 0; round < BENCH_ROUNDS; ++round) {
+		read_hot(hot);
+
+		perf_start(fd);
+		start = now();
+		switch (op) {
+		case 0:
+			memcpy(dest, src, size);
+			break;
+		case 1:
+			memcpy_stream(dest, src, size);
+			break;
+		case 2:
+			memset(dest, 0, size);
+			break;
+		default:
+			memset_stream(dest, 0, size);
+			break;
+		}
+		t = now() - start;
+		op_count = perf_stop(fd);
+
+		perf_start(fd);
+		start = now();
+		read_hot(hot);
+		hot_count = perf_stop(fd);
+
+		if (0 == round || t < best) {
+			best = t;
+			hot_time = now() - start;
+			misses = op_count;
+			hot_misses = hot_count;
+		}
+	}
+
+	printf("%-14s %6llu K %8.3f ms %7.2f GB/s", names[op],
+			size / (1 KILOBYTE), best * 1e3, size / best / 1e9);
+	print_count(misses);
+	printf(" %8.1f us", hot_time * 1e6);
+	print_count(hot_misses);
+	printf("\n");
+}
+
+/* -s: cached against streaming stores, see the top of the file */
+static int stream_bench(uint32_t top)
+{
+	static const uint64_t sizes[] = {
+		256 KILOBYTE, 1 MEGABYTE, 4 MEGABYTE, 16 MEGABYTE,
+		32 MEGABYTE, STREAM_MAX,
+	};
+	uint8_t *src, *dest, *hot;
+	void *p;
+	uint32_t i, op;
+	int fd = perf_open();
+
+	if (posix_memalign(&p, 4 KILOBYTE, 2 * STREAM_MAX + HOT_SIZE))
+		return 1;
+	src = p;
+	dest = src + STREAM_MAX;
+	hot = dest + STREAM_MAX;
+	fill(src, STREAM_MAX + HOT_SIZE);
+	memset(dest, 1, STREAM_MAX);
+
+	util_init(top);
+	printf("%s kernels, LLC misses %s\n", simd_name(top),
+			(fd < 0) ? "not available" : "counted");
+	printf("%-14s %8s %11s %12s %10s %11s %10s\n", "", "size", "time",
+			"rate", "misses", "hot set", "misses");
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		for (op = 0; op < 4; ++op)
+			stream_row(op, dest, src, hot, sizes[i], fd);
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	/* the size classes of util.c, then L1, L2 and memory sized copies */
+	static const uint64_t sizes[] = {
+		8, 63, 64, 256, 511, 512, 4 KILOBYTE, 64 KILOBYTE,
+		1 MEGABYTE, BENCH_MAX,
+	};
+	uint32_t top = host_simd_level();
+	uint32_t level, i, op;
+	boolean_t check_only = FALSE;
+	void *p;
+
+	if ((2 == argc) && !strcmp(argv[1], "-s"))
+		return stream_bench(top);
+	if ((2 == argc) && !strcmp(argv[1], "-c"))
+		check_only = TRUE;
+	else if (argc > 1) {
+		printf("usage: %s [-c|-s]\n", argv[0]);
+		return 2;
+	}
+
+	libc_memcpy = (libc_copy_t)dlsym(RTLD_NEXT, "memcpy");
+	libc_memmove = (libc_copy_t)dlsym(RTLD_NEXT, "memmove");
+	if (!libc_memcpy || !libc_memmove) {
+		printf("no C library memcpy()/memmove()\n");
+		return 1;
+	}
+
+	if (posix_memalign(&p, 4 KILOBYTE, BUF_SIZE))
+		return 1;
+	buf = p;
+	if (posix_memalign(&p, 4 KILOBYTE, BUF_SIZE))
+		return 1;
+	ref = p;
+
+	for (level = SIMD_NONE; level <= top; ++level) {
+		util_init(level);
+		if (!check_memcpy() || !check_memmove()) {
+			printf("%s: check failed\n", simd_name(level));
+			return 1;
+		}
+		printf("%s: memcpy and memmove match the C library\n",
+				simd_name(level));
+	}
+	if (check_only)
+		return 0;
+
+	printf("\n%-12s %9s %-9s %9s %9s %9s  GB/s\n", "", "bytes", "",
+			simd_name(top), "scalar", "libc");
+	for (op = COPY; op <= MOVE_BACKWARD; ++op) {
+		for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+			bench_row((bench_op_t)op, top, sizes[i], 0);
+			bench_row((bench_op_t)op, top, sizes[i], 1);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+################################################################################
+# Copyright (c) 2018 Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+################################################################################
+
+"""Generate a synthetic lk.elf-like image for the host loader harness.
+
+The image is an ET_DYN file linked at 0, vaddr == file offset unless
+the segments are 2M aligned:
+
+    PT_LOAD R    ELF header, program headers, .dynsym, .rela.dyn
+    PT_LOAD RX / R / RW, in turn, up to the requested segment count
+    the last PT_LOAD is RW and ends with .dynamic and a bss
+    PT_DYNAMIC
+
+Segment contents are about half random, half repeated, so they compress
+roughly as well as real code does. Relocations point at distinct words of
+the RW segments, sorted, R_X86_64_RELATIVE first and then a few
+R_X86_64_64 against the one defined symbol. Every relocated word holds
+its own link address in the file and the relocation resolves to its own
+runtime address, which is what tools/host_elf.c checks after loading:
+each word is either unchanged or, if it held its link address, moved by
+the load offset. relrpack.py, lz4pack.py and prelink.py take the image
+like a real one.
+"""
+
+import argparse
+import random
+import struct
+import sys
+
+from elfimage import (EHDR, PHDR, DYN, RELA, SYM, ELFCLASS64, ELFDATA2LSB,
+                      EM_X86_64, PT_LOAD, PT_DYNAMIC, DT_NULL, DT_SYMTAB,
+                      DT_RELA, DT_RELASZ, DT_RELAENT, DT_RELACOUNT,
+                      R_X86_64_64, R_X86_64_RELATIVE, PF_R, PF_W, PF_X)
+
+PAGE = 4096
+WORD = 8
+MB = 1024 * 1024
+
+ET_DYN = 3
+DT_SYMENT = 11
+DYN_SLOTS = 16
+CHUNK = 64
+
+SEGMENT_FLAGS = (PF_R | PF_X, PF_R, PF_R | PF_W)
+
+
+def page_align(n):
+    return (n + PAGE - 1) & ~(PAGE - 1)
+
+
+def contents(rng, size):
+    """size bytes, 64-byte chunks either random or a copy of an earlier one."""
+    out = bytearray(rng.randbytes(min(size, PAGE)))
+    while len(out) < size:
+        if rng.random() < 0.5:
+            out += rng.randbytes(CHUNK)
+        else:
+            start = rng.randrange(0, len(out) - CHUNK + 1)
+            out += out[start:start + CHUNK]
+    return out[:size]
+
+
+def generate(size, segments, relocs, symbolic, bss, align, seed):
+    """The image as bytes."""
+    rng = random.Random(seed)
+    phnum = segments + 1
+    header_size = EHDR.size + phnum * PHDR.size
+
+    # segment 0: headers, the symbol table and the relocations
+    symtab = header_size + (-header_size % WORD)
+    rela = symtab + 2 * SYM.size
+    seg0_size = page_align(rela + relocs * RELA.size)
+
+    # the others share size, each a whole number of pages
+    per_seg = max(PAGE, page_align(size // (segments - 1)))
+    layout = []
+    vaddr = seg0_size
+    for i in range(segments - 1):
+        flags = SEGMENT_FLAGS[i % 3] if i < segments - 2 else PF_R | PF_W
+        if align > PAGE:
+            vaddr = (vaddr + align - 1) & ~(align - 1)
+        layout.append([flags, vaddr, per_seg])
+        vaddr += per_seg
+
+    last = layout[-1]
+    dynamic = last[1] + last[2] - DYN_SLOTS * DYN.size
+
+    # relocation targets: distinct words of the RW segments, not .dynamic
+    slots = []
+    for flags, vaddr, filesz in layout:
+        if flags & PF_W:
+            end = dynamic if vaddr == last[1] else vaddr + filesz
+            slots.append((vaddr, (end - vaddr) // WORD))
+    total = sum(n for _, n in slots)
+    if relocs > total:
+        raise ValueError('%d relocations do not fit in %d RW words'
+                         % (relocs, total))
+    picks = sorted(rng.sample(range(total), relocs))
+    targets = []
+    base_word = 0
+    it = iter(slots)
+    vaddr, n = next(it)
+    for pick in picks:
+        while pick >= base_word + n:
+            base_word += n
+            vaddr, n = next(it)
+        targets.append(vaddr + (pick - base_word) * WORD)
+
+    n_symbolic = relocs * symbolic // 100
+    n_relative = relocs - n_symbolic
+    sym_value = layout[-1][1]
+
+    offsets = []
+    offset = seg0_size
+    for flags, vaddr, filesz in layout:
+        offset += (vaddr - offset) % PAGE
+        offsets.append(offset)
+        offset += filesz
+    out = bytearray(offset)
+
+    def file_off(addr):
+        for (flags, vaddr, filesz), off in zip(layout, offsets):
+            if vaddr <= addr < vaddr + filesz:
+                return off + addr - vaddr
+        raise ValueError('0x%x not in a segment' % addr)
+
+    for (flags, vaddr, filesz), off in zip(layout, offsets):
+        out[off:off + filesz] = contents(rng, filesz)
+
+    # .rela.dyn and the words it relocates
+    table = bytearray()
+    for i, target in enumerate(targets):
+        struct.pack_into('<Q', out, file_off(target), target)
+        if i < n_relative:
+            table += RELA.pack(target, R_X86_64_RELATIVE, target)
+        else:
+            table += RELA.pack(target, (1 << 32) | R_X86_64_64,
+                               target - sym_value)
+    out[rela:rela + len(table)] = table
+
+    # .dynsym: the null symbol and one defined, global object
+    out[symtab:symtab + SYM.size] = bytes(SYM.size)
+    out[symtab + SYM.size:rela] = SYM.pack(0, 0x11, 0, 1, sym_value, WORD)
+
+    entries = [(DT_SYMTAB, symtab), (DT_SYMENT, SYM.size), (DT_RELA, rela),
+               (DT_RELASZ, len(table)), (DT_RELAENT, RELA.size),
+               (DT_RELACOUNT, n_relative)]
+    dyn_off = file_off(dynamic)
+    for i in range(DYN_SLOTS):
+        tag, val = entries[i] if i < len(entries) else (DT_NULL, 0)
+        DYN.pack_into(out, dyn_off + i * DYN.size, tag, val)
+
+    phdrs = [PHDR.pack(PT_LOAD, PF_R, 0, 0, 0, seg0_size, seg0_size, PAGE)]
+    for i, ((flags, vaddr, filesz), off) in enumerate(zip(layout, offsets)):
+        memsz = filesz + (bss if i == len(layout) - 1 else 0)
+        phdrs.append(PHDR.pack(PT_LOAD, flags, off, vaddr, vaddr, filesz,
+                               memsz, max(align, PAGE)))
+    phdrs.append(PHDR.pack(PT_DYNAMIC, PF_R | PF_W, dyn_off, dynamic,
+                           dynamic, DYN_SLOTS * DYN.size,
+                           DYN_SLOTS * DYN.size, WORD))
+
+    ident = b'\x7fELF' + bytes([ELFCLASS64, ELFDATA2LSB, 1]) + bytes(9)
+    out[:EHDR.size] = EHDR.pack(ident, ET_DYN, EM_X86_64, 1, layout[0][1],
+                                EHDR.size, 0, 0, EHDR.size, PHDR.size, phnum,
+                                0, 0, 0)
+    out[EHDR.size:EHDR.size + phnum * PHDR.size] = b''.join(phdrs)
+
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('output', help='ELF image to write')
+    parser.add_argument('--size', type=float, default=4,
+                        help='MB of segment contents, 1 to 64 (default 4)')
+    parser.add_argument('--segments', type=int, default=8,
+                        help='PT_LOAD segments, at least 2 (default 8)')
+    parser.add_argument('--relocs', type=int, default=10000,
+                        help='relocation entries (default 10000)')
+    parser.add_argument('--symbolic', type=int, default=1,
+                        help='percent of them R_X86_64_64 (default 1)')
+    parser.add_argument('--bss', type=int, default=MB,
+                        help='bss bytes after the last segment (default 1M)')
+    parser.add_argument('--align', choices=('4k', '2m'), default='4k',
+                        help='segment p_align (default 4k)')
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    if args.segments < 2:
+        parser.error('--segments must be at least 2')
+
+    data = generate(int(args.size * MB), args.segments, args.relocs,
+                    args.symbolic, args.bss,
+                    2 * MB if args.align == '2m' else PAGE, args.seed)
+    with open(args.output, 'wb') as f:
+        f.write(data)
+
+    print('%s: 0x%x bytes, %d PT_LOAD segments, %d relocations'
+          % (args.output, len(data), args.segments, args.relocs))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+################################################################################
+# Copyright (c) 2018 Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+################################################################################
+
+"""Build the image package the trusty loader takes its images from.
+
+Layout (see trusty_pkg_hdr_t / trusty_pkg_image_t in package.h):
+
+    trusty_pkg_hdr_t
+    trusty_pkg_image_t[image_count]
+    images, each at a multiple of align from the start of the package
+
+Each table entry carries the image's name, offset, size and, for ELF,
+LZ4 and snapshot images, its measurement (tools/measure.py).
+
+By default the package is written on its own, for vSBL to load as the
+multiboot module named "trusty". With --embed it is appended to the
+loader instead, aligned in memory as well. The loader's .bss is not in
+trusty_loader.bin but follows it up to bss_end_addr, so the package
+starts past that and the gap is zero filled in the file; trusty_pkg_offset
+and the multiboot load_end_addr and bss_end_addr of the loader are
+patched to cover it.
+"""
+
+import argparse
+import struct
+import sys
+
+from measure import measure
+
+TRUSTY_PKG_MAGIC = 0x474b5054   # "TPKG"
+TRUSTY_PKG_VERSION = 1
+TRUSTY_PKG_MEASURED = 0x1
+
+PKG_HDR = struct.Struct('<IIIIQQ')
+PKG_IMAGE = struct.Struct('<16sQQII32s')
+
+MULTIBOOT_HEADER_MAGIC = 0x1BADB002
+MULTIBOOT_AOUT_KLUDGE = 1 << 16
+# multiboot header fields, then trusty_pkg_offset in trusty_loader_entry.S
+MB_FLAGS = 4
+MB_LOAD_ADDR = 16
+MB_LOAD_END_ADDR = 20
+MB_BSS_END_ADDR = 24
+LOADER_PKG_OFFSET = 32
+
+ALIGNMENTS = {'4k': 0x1000, '2m': 0x200000}
+
+
+def align_up(value, align):
+    return (value + align - 1) & ~(align - 1)
+
+
+def build(images, align, base=0):
+    """images is a list of (name, data). base is the address the package
+    will be loaded at, the images are aligned in memory from there."""
+    header_size = PKG_HDR.size + len(images) * PKG_IMAGE.size
+    offset = align_up(base + header_size, align) - base
+    table = b''
+    body = bytearray()
+    for name, data in images:
+        if len(name.encode()) > 16:
+            raise ValueError('image name %s longer than 16 bytes' % name)
+        try:
+            digest, flags = measure(data), TRUSTY_PKG_MEASURED
+        except (ValueError, struct.error):
+            digest, flags = bytes(32), 0
+        table += PKG_IMAGE.pack(name.encode(), offset, len(data), flags, 0,
+                                digest)
+        body += bytes(offset - header_size - len(body)) + data
+        offset = align_up(base + header_size + len(body), align) - base
+
+    size = header_size + len(body)
+    return PKG_HDR.pack(TRUSTY_PKG_MAGIC, TRUSTY_PKG_VERSION, header_size,
+                        len(images), size, align) + table + bytes(body)
+
+
+def embed(loader, images, align):
+    """The loader with the package appended past its .bss, the multiboot
+    fields patched."""
+    loader = bytearray(loader)
+    magic, flags = struct.unpack_from('<II', loader)
+    if magic != MULTIBOOT_HEADER_MAGIC or not flags & MULTIBOOT_AOUT_KLUDGE:
+        raise ValueError('loader has no multiboot header with load addresses')
+    load_addr, load_end, bss_end = struct.unpack_from('<III', loader,
+                                                      MB_LOAD_ADDR)
+    if load_end != load_addr + len(loader) or \
+            (bss_end and bss_end < load_end):
+        raise ValueError('loader load_end_addr 0x%x or bss_end_addr 0x%x '
+                         'does not match its 0x%x bytes'
+                         % (load_end, bss_end, len(loader)))
+
+    # the .bss is zeroes in the file now, vSBL has nothing left to clear
+    pkg_offset = align_up(max(load_end, bss_end), align) - load_addr
+    pkg = build(images, align, load_addr + pkg_offset)
+    out = loader + bytes(pkg_offset - len(loader)) + pkg
+    struct.pack_into('<I', out, LOADER_PKG_OFFSET, pkg_offset)
+    struct.pack_into('<II', out, MB_LOAD_END_ADDR, load_addr + len(out),
+                     load_addr + len(out))
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('images', nargs='+', metavar='NAME=FILE',
+                        help='image to add, NAME defaults to trusty')
+    parser.add_argument('-o', '--output', required=True,
+                        help='package, or loader and package with --embed')
+    parser.add_argument('--align', choices=sorted(ALIGNMENTS), default='4k',
+                        help='image alignment (default 4k)')
+    parser.add_argument('--embed', metavar='LOADER',
+                        help='append the package to trusty_loader.bin')
+    args = parser.parse_args()
+
+    images = []
+    for arg in args.images:
+        name, _, path = arg.rpartition('=')
+        with open(path, 'rb') as f:
+            images.append((name or 'trusty', f.read()))
+
+    align = ALIGNMENTS[args.align]
+    if args.embed:
+        with open(args.embed, 'rb') as f:
+            out = embed(f.read(), images, align)
+    else:
+        out = build(images, align)
+
+    with open(args.output, 'wb') as f:
+        f.write(out)
+
+    for name, data in images:
+        print('%s: %s, 0x%x bytes' % (args.output, name, len(data)))
+    print('%s: 0x%x bytes, images aligned to 0x%x' %
+          (args.output, len(out), align))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,249 @@
+#!/usr/bin/env python3
+################################################################################
+# Copyright (c) 2018 Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+################################################################################
+
+"""Prelink lk.elf for the trusty runtime base into a runtime snapshot.
+
+Layout (see elf_snapshot_hdr_t in elf_ld.h):
+
+    elf_snapshot_hdr_t, padded to 4K
+    runtime image from the lowest PT_LOAD address on, relocated for base
+    fallback image (lk.elf or lk.lz4), 4K aligned
+
+The runtime image is what relocate_elf_image() would leave at base: the
+segments at their offsets, zero-filled gaps, program headers patched and
+relocations applied. Only the bss at its end is left out. The loader
+copies it in one go when it runs with the same base, then applies the
+.altinstructions table for its CPU, and loads the fallback image
+otherwise. The header carries the SHA-256 of the runtime image and the
+measurement of the fallback image (see measure.py).
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+from elfimage import (ElfImage, SYM, RELA, PHDR, DT_RELA, DT_RELASZ,
+                      DT_JMPREL, DT_PLTRELSZ, DT_RELR, DT_RELRSZ, DT_SYMTAB,
+                      R_X86_64_NONE, R_X86_64_64, R_X86_64_GLOB_DAT,
+                      R_X86_64_JMP_SLOT, R_X86_64_RELATIVE, R_X86_64_32,
+                      R_X86_64_IRELATIVE, SHN_UNDEF, SHN_ABS, STB_WEAK)
+from measure import ELF_SNAP_MAGIC, SNAP_HDR, measure
+
+ELF_SNAP_VERSION = 3
+
+ALT_INSTR_SECTION = '.altinstructions'
+
+PAGE_SIZE = 4096
+MASK64 = (1 << 64) - 1
+
+# TRUSTY_RUNTIME_BASE + TRUSTY_RSVD_SIZE in trusty_loader.c
+DEFAULT_BASE = 0x7FC0000000 + 0x1000
+
+# ELF_MAX_SEGMENT_ALIGN in elf_ld.h
+MAX_SEGMENT_ALIGN = 2 * 1024 * 1024
+
+
+def page_align(n):
+    return (n + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)
+
+
+class RuntimeImage(object):
+    """The loaded segments, addressed by link time address."""
+
+    def __init__(self, elf, low):
+        self.low = low
+        self.mem = bytearray()
+        for p in elf.loads():
+            start = p.p_paddr - low
+            self.extend(start + p.p_filesz)
+            self.mem[start:start + p.p_filesz] = \
+                elf.data[p.p_offset:p.p_offset + p.p_filesz]
+
+    def extend(self, size):
+        if size > len(self.mem):
+            self.mem += bytes(size - len(self.mem))
+
+    def read64(self, addr):
+        return struct.unpack_from('<Q', self.mem, addr - self.low)[0]
+
+    def write64(self, addr, val):
+        self.extend(addr - self.low + 8)
+        struct.pack_into('<Q', self.mem, addr - self.low, val & MASK64)
+
+    def write32(self, addr, val):
+        if val >> 32:
+            raise ValueError('R_X86_64_32 at 0x%x overflows' % addr)
+        self.extend(addr - self.low + 4)
+        struct.pack_into('<I', self.mem, addr - self.low, val)
+
+
+def apply_relocations(elf, image, offset):
+    dyn = dict(elf.dynamic())
+
+    if dyn.get(DT_RELR) and dyn.get(DT_RELRSZ):
+        where = 0
+        for i in range(dyn[DT_RELRSZ] // 8):
+            entry = image.read64(dyn[DT_RELR] + i * 8)
+            if not entry & 1:
+                image.write64(entry, image.read64(entry) + offset)
+                where = entry + 8
+                continue
+            for bit in range(63):
+                if entry >> (bit + 1) & 1:
+                    addr = where + bit * 8
+                    image.write64(addr, image.read64(addr) + offset)
+            where += 63 * 8
+
+    for table, size in ((DT_RELA, DT_RELASZ), (DT_JMPREL, DT_PLTRELSZ)):
+        if dyn.get(table) and dyn.get(size):
+            apply_rela(image, dyn, dyn[table], dyn[size], offset)
+
+
+def symbol_value(image, dyn, r_info, offset):
+    index = r_info >> 32
+    if index == 0:
+        return 0
+    _, st_info, _, st_shndx, st_value, _ = SYM.unpack_from(
+        image.mem, dyn[DT_SYMTAB] - image.low + index * SYM.size)
+    if st_shndx == SHN_UNDEF:
+        if st_info >> 4 == STB_WEAK:
+            return 0
+        raise ValueError('symbol %d is undefined' % index)
+    return st_value if st_shndx == SHN_ABS else st_value + offset
+
+
+def apply_rela(image, dyn, addr, size, offset):
+    start = addr - image.low
+    for off in range(start, start + size, RELA.size):
+        r_offset, r_info, r_addend = RELA.unpack_from(image.mem, off)
+        r_type = r_info & 0xff
+        if r_type == R_X86_64_NONE:
+            continue
+        if r_type == R_X86_64_RELATIVE:
+            image.write64(r_offset, r_addend + offset)
+        elif r_type in (R_X86_64_GLOB_DAT, R_X86_64_JMP_SLOT):
+            image.write64(r_offset, symbol_value(image, dyn, r_info, offset))
+        elif r_type == R_X86_64_64:
+            image.write64(r_offset,
+                          symbol_value(image, dyn, r_info, offset) + r_addend)
+        elif r_type == R_X86_64_32:
+            image.write32(r_offset,
+                          symbol_value(image, dyn, r_info, offset) + r_addend)
+        elif r_type == R_X86_64_IRELATIVE:
+            raise ValueError('R_X86_64_IRELATIVE resolvers must run on the '
+                             'target, the image cannot be prelinked')
+        else:
+            raise ValueError('unsupported relocation type %d' % r_type)
+
+
+def place(elf, base):
+    """The address elf64_load_executable() loads the image at when asked
+    for base: moved up so every segment keeps its p_align, up to 2M."""
+    align = PAGE_SIZE
+    for p in elf.loads():
+        if p.p_align > align and not p.p_align & (p.p_align - 1):
+            align = min(p.p_align, MAX_SEGMENT_ALIGN)
+    low = min(p.p_paddr for p in elf.loads())
+    return base + ((low - base) & (align - 1))
+
+
+def prelink(elf, base):
+    loads = elf.loads()
+    low = min(p.p_paddr for p in loads)
+    high = max(p.p_paddr + p.p_memsz for p in loads)
+    if low % PAGE_SIZE:
+        raise ValueError('lowest segment 0x%x is not page aligned' % low)
+    offset = base - low
+
+    image = RuntimeImage(elf, low)
+
+    # the segment at file offset 0 carries the program headers along
+    first = [p for p in loads if p.p_offset == 0]
+    if first:
+        for i in range(elf.e_phnum):
+            off = first[0].p_paddr - low + elf.e_phoff + i * elf.e_phentsize
+            fields = list(PHDR.unpack_from(image.mem, off))
+            if fields[6]:               # p_memsz
+                fields[3] = (fields[3] + offset) & MASK64
+                fields[4] = (fields[4] + offset) & MASK64
+            PHDR.pack_into(image.mem, off, *fields)
+
+    apply_relocations(elf, image, offset)
+
+    data_size = len(image.mem)
+    return image.mem, high - low - data_size, elf.e_entry - low, low
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('input', help='trusty ELF image (lk.elf)')
+    parser.add_argument('output', help='snapshot to write')
+    parser.add_argument('--base', type=lambda s: int(s, 0),
+                        default=DEFAULT_BASE,
+                        help='lowest runtime address, moved up for the '
+                             'segment alignment (default 0x%x)' % DEFAULT_BASE)
+    parser.add_argument('--fallback',
+                        help='image loaded for any other base '
+                             '(default: the input ELF)')
+    parser.add_argument('--no-fallback', action='store_true',
+                        help='fail to boot if the base ever changes')
+    args = parser.parse_args()
+
+    elf = ElfImage.from_file(args.input)
+    args.base = place(elf, args.base)
+    data, bss_size, entry_offset, low = prelink(elf, args.base)
+
+    # patched by the loader for the CPU it runs on
+    alt = elf.section(ALT_INSTR_SECTION)
+    alt_offset, alt_size = (alt.sh_addr - low, alt.sh_size) if alt else (0, 0)
+
+    fallback = b''
+    if not args.no_fallback:
+        if args.fallback:
+            with open(args.fallback, 'rb') as f:
+                fallback = f.read()
+        else:
+            fallback = bytes(elf.data)
+
+    data_offset = page_align(SNAP_HDR.size)
+    elf_offset = page_align(data_offset + len(data)) if fallback else 0
+
+    data_digest = hashlib.sha256(data).digest()
+    elf_digest = measure(fallback) if fallback else bytes(32)
+
+    out = bytearray(SNAP_HDR.pack(ELF_SNAP_MAGIC, ELF_SNAP_VERSION,
+                                  args.base, data_offset, len(data),
+                                  bss_size, entry_offset, elf_offset,
+                                  len(fallback), alt_offset, alt_size,
+                                  data_digest, elf_digest))
+    out += bytes(data_offset - len(out))
+    out += data
+    if fallback:
+        out += bytes(elf_offset - len(out))
+        out += fallback
+
+    with open(args.output, 'wb') as f:
+        f.write(out)
+
+    print('%s: 0x%x bytes prelinked for 0x%x, 0x%x bytes bss'
+          % (args.output, len(data), args.base, bss_size))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
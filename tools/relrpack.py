@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+################################################################################
+# Copyright (c) 2018 Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+################################################################################
+
+"""Convert the R_X86_64_RELATIVE entries of lk.elf into a DT_RELR table.
+
+For toolchains that cannot emit DT_RELR themselves (-z pack-relative-relocs).
+Each relative addend is written into the word it relocates, the word
+addresses are encoded as RELR address/bitmap entries, and the table is
+stored at the start of the old DT_RELA area. Relocations of any other type
+stay in DT_RELA right behind it. The dynamic section is rewritten in place;
+DT_RELACOUNT, and DT_DEBUG if the slots are needed, are dropped.
+
+Section headers are left alone, .rela.dyn keeps its old size there. The
+loader only looks at the program headers and the dynamic section.
+"""
+
+import argparse
+import struct
+import sys
+
+from elfimage import (ElfImage, DYN, RELA, DT_RELA, DT_RELASZ, DT_RELAENT,
+                      DT_DEBUG, DT_RELR, DT_RELRSZ, DT_RELRENT, DT_RELACOUNT,
+                      R_X86_64_RELATIVE)
+
+WORD = 8
+BITMAP_WORDS = 63
+
+
+def encode_relr(offsets):
+    """Encode sorted, word aligned addresses as RELR entries."""
+    out = []
+    i = 0
+    while i < len(offsets):
+        out.append(offsets[i])
+        base = offsets[i] + WORD
+        i += 1
+        while True:
+            bitmap = 0
+            while i < len(offsets):
+                delta = offsets[i] - base
+                if delta >= BITMAP_WORDS * WORD or delta % WORD:
+                    break
+                bitmap |= 1 << (delta // WORD)
+                i += 1
+            if not bitmap:
+                break
+            out.append((bitmap << 1) | 1)
+            base += BITMAP_WORDS * WORD
+    return out
+
+
+def convert(elf):
+    dyn = dict(elf.dynamic())
+    if DT_RELR in dyn:
+        raise ValueError('image already has a DT_RELR table')
+    if DT_RELA not in dyn or not dyn.get(DT_RELASZ):
+        raise ValueError('image has no DT_RELA table')
+    if dyn.get(DT_RELAENT) != RELA.size:
+        raise ValueError('unexpected DT_RELAENT %r' % dyn.get(DT_RELAENT))
+
+    rela_addr = dyn[DT_RELA]
+    rela_size = dyn[DT_RELASZ]
+    rela_off = elf.vaddr_to_offset(rela_addr)
+
+    relative = {}
+    others = []
+    for off in range(rela_off, rela_off + rela_size, RELA.size):
+        r_offset, r_info, r_addend = RELA.unpack_from(elf.data, off)
+        if ((r_info & 0xffffffff) == R_X86_64_RELATIVE
+                and r_offset % WORD == 0):
+            try:
+                target = elf.vaddr_to_offset(r_offset)
+            except ValueError:
+                # the target lives in bss, nowhere to keep the addend
+                others.append((r_offset, r_info, r_addend))
+                continue
+            relative[r_offset] = (target, r_addend)
+        else:
+            others.append((r_offset, r_info, r_addend))
+
+    for target, addend in relative.values():
+        struct.pack_into('<q', elf.data, target, addend)
+
+    relr = encode_relr(sorted(relative))
+    relr_size = len(relr) * WORD
+    table = bytearray(struct.pack('<%dQ' % len(relr), *relr))
+    for entry in others:
+        table += RELA.pack(*entry)
+    # RELR never takes more room than the rela entries it replaces
+    table += bytes(rela_size - len(table))
+    elf.data[rela_off:rela_off + rela_size] = table
+
+    drop = {DT_RELACOUNT, DT_RELR, DT_RELRSZ, DT_RELRENT}
+    if not others:
+        drop |= {DT_RELA, DT_RELASZ, DT_RELAENT}
+    entries = []
+    for tag, val in elf.dynamic():
+        if tag in drop:
+            continue
+        if tag == DT_RELA:
+            val = rela_addr + relr_size
+        elif tag == DT_RELASZ:
+            val = len(others) * RELA.size
+        entries.append((tag, val))
+    entries += [(DT_RELR, rela_addr), (DT_RELRSZ, relr_size),
+                (DT_RELRENT, WORD)]
+
+    slots = elf.dynamic_phdr().p_filesz // DYN.size
+    if len(entries) >= slots:
+        entries = [e for e in entries if e[0] != DT_DEBUG]
+    elf.write_dynamic(entries)
+
+    return len(relative), len(others), relr_size
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('input', help='trusty ELF image (lk.elf)')
+    parser.add_argument('output', help='ELF image to write')
+    args = parser.parse_args()
+
+    elf = ElfImage.from_file(args.input)
+    relative, others, relr_size = convert(elf)
+    with open(args.output, 'wb') as f:
+        f.write(elf.data)
+
+    print('%s: %d relative relocations packed into %d bytes, %d kept as rela'
+          % (args.output, relative, relr_size, others))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
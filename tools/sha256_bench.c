@@ -0,0 +1,286 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+/*
+ * Host benchmark of the loader's SHA-256 kernels, "make sha256_bench".
+ * Each kernel hashes 16 MB on its own, then hashes it and copies it to a
+ * second buffer, once as two passes and once with sha256_update_copy().
+ * sha256.c and sha256_ni.S are built unchanged for the host, cpu.c is
+ * replaced by the stubs below: they answer from cpuid directly and can
+ * hide SHA-NI to time the scalar kernel. util.c would replace the C
+ * library's memcpy(), its streaming copy is stubbed with SSE2 too.
+ *
+ * The loader headers define their own fixed width types, so no libc
+ * header that defines them can be included here.
+ */
+#include <time.h>
+
+#include "sha256.h"
+#include "cpu.h"
+#include "util.h"
+
+int printf(const char *fmt, ...);
+void *malloc(unsigned long size);
+void free(void *ptr);
+int strcmp(const char *a, const char *b);
+int memcmp(const void *a, const void *b, unsigned long size);
+
+#define BENCH_SIZE      (16 MEGABYTE)
+#define BENCH_ROUNDS    8
+
+static boolean_t hide_sha_ni;
+
+void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx,
+		uint32_t *ecx, uint32_t *edx)
+{
+	__asm__ __volatile__ ("cpuid"
+			: "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+			: "a" (leaf), "c" (subleaf));
+}
+
+boolean_t cpu_has_feature(uint32_t feature)
+{
+	uint32_t r[4];
+
+	if (hide_sha_ni && X86_FEATURE_SHA_NI == feature)
+		return FALSE;
+
+	switch (feature / 32) {
+	case CPUID_1_ECX:
+		cpuid(1, 0, &r[0], &r[1], &r[2], &r[3]);
+		return (r[2] >> (feature % 32)) & 1;
+	case CPUID_7_EBX:
+		cpuid(0, 0, &r[0], &r[1], &r[2], &r[3]);
+		if (r[0] < 7)
+			return FALSE;
+		cpuid(7, 0, &r[0], &r[1], &r[2], &r[3]);
+		return (r[1] >> (feature % 32)) & 1;
+	default:
+		return FALSE;
+	}
+}
+
+/* the host OS has SSE enabled */
+uint32_t cpu_simd_level(void)
+{
+	return SIMD_SSE2;
+}
+
+/* util.c's, 64M and up is streamed with 16 byte non-temporal stores */
+void memcpy_stream_part(void *dest, const void *src, uint64_t count,
+		uint64_t total)
+{
+	uint8_t *d = (uint8_t *)dest;
+	const uint8_t *s = (const uint8_t *)src;
+	uint64_t head = (0 - (uint64_t)d) & 15;
+
+	if ((total < 64 MEGABYTE) || (count < head + 16)) {
+		memcpy(dest, src, count);
+		return;
+	}
+
+	memcpy(d, s, head);
+	d += head;
+	s += head;
+	count -= head;
+	for (; count >= 16; count -= 16, d += 16, s += 16)
+		__asm__ __volatile__ ("movdqu (%1), %%xmm0\n\t"
+				"movntdq %%xmm0, (%0)"
+				:: "r" (d), "r" (s) : "xmm0", "memory");
+	memcpy(d, s, count);
+}
+
+void memcpy_stream_end(void)
+{
+	__asm__ __volatile__ ("sfence" ::: "memory");
+}
+
+static void digest_hex(const uint8_t digest[SHA256_DIGEST_SIZE], char *out)
+{
+	static const char hex[] = "0123456789abcdef";
+	uint32_t i;
+
+	for (i = 0; i < SHA256_DIGEST_SIZE; ++i) {
+		out[i * 2] = hex[digest[i] >> 4];
+		out[i * 2 + 1] = hex[digest[i] & 0xF];
+	}
+	out[SHA256_DIGEST_SIZE * 2] = 0;
+}
+
+/* FIPS 180-2 examples, fed in odd sized pieces to cover the buffering */
+static boolean_t self_test(void)
+{
+	static const struct {
+		const char *msg;
+		uint32_t repeat;
+		const char *digest;
+	} vectors[] = {
+		{ "", 1,
+		  "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+		{ "abc", 1,
+		  "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+		{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+		  "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+		{ "a", 1000000,
+		  "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+	};
+	sha256_ctx_t ctx;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	char hex[SHA256_DIGEST_SIZE * 2 + 1];
+	uint64_t len;
+	uint32_t i, j;
+
+	for (i = 0; i < sizeof(vectors) / sizeof(vectors[0]); ++i) {
+		for (len = 0; vectors[i].msg[len]; ++len)
+			;
+
+		sha256_init(&ctx);
+		for (j = 0; j < vectors[i].repeat; ++j)
+			sha256_update(&ctx, vectors[i].msg, len);
+		sha256_final(&ctx, digest);
+
+		digest_hex(digest, hex);
+		if (strcmp(hex, vectors[i].digest)) {
+			printf("vector %u: got %s\n", i, hex);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* 0: hash only, 1: hash, then copy, 2: sha256_update_copy() */
+static double run(uint32_t mode, uint8_t *dest, const uint8_t *src,
+		uint64_t skew, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	sha256_ctx_t ctx;
+	double start = now();
+
+	sha256_init(&ctx);
+	/* a few header bytes first, like the loader, so the segment data
+	 * does not start on a block boundary */
+	sha256_update(&ctx, src, skew);
+	if (2 == mode) {
+		sha256_update_copy(&ctx, dest, src, BENCH_SIZE);
+	} else {
+		sha256_update(&ctx, src, BENCH_SIZE);
+		if (1 == mode)
+			memcpy(dest, src, BENCH_SIZE);
+	}
+	sha256_final(&ctx, digest);
+
+	return now() - start;
+}
+
+static boolean_t bench(const char *name, uint8_t *dest, const uint8_t *src)
+{
+	static const char *modes[] = { "hash", "hash+copy", "fused" };
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	uint8_t ref[SHA256_DIGEST_SIZE];
+	char hex[SHA256_DIGEST_SIZE * 2 + 1];
+	double best, t;
+	uint32_t mode, i;
+
+	for (mode = 0; mode < 3; ++mode) {
+		best = 0;
+		for (i = 0; i < BENCH_ROUNDS; ++i) {
+			t = run(mode, dest, src, 120, digest);
+			if (0 == i || t < best)
+				best = t;
+		}
+
+		if (0 == mode) {
+			memcpy(ref, digest, SHA256_DIGEST_SIZE);
+		} else if (memcmp(ref, digest, SHA256_DIGEST_SIZE) ||
+				memcmp(dest, src, BENCH_SIZE)) {
+			printf("%s %s: wrong digest or copy\n", name, modes[mode]);
+			return FALSE;
+		}
+		memset(dest, 0, BENCH_SIZE);
+
+		digest_hex(digest, hex);
+		printf("%-8s %-10s 16 MB in %7.2f ms, %7.1f MB/s  %.16s\n",
+				name, modes[mode], best * 1e3, 16 / best, hex);
+	}
+
+	/* the fused kernel with an unaligned destination */
+	run(2, dest + 3, src, 64, digest);
+	run(0, dest, src, 64, ref);
+	if (memcmp(ref, digest, SHA256_DIGEST_SIZE) ||
+			memcmp(dest + 3, src, BENCH_SIZE)) {
+		printf("%s fused: unaligned copy failed\n", name);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t *buf;
+	uint8_t *dest;
+	uint64_t i;
+	uint32_t x = 0x12345678;
+	boolean_t has_sha_ni = cpu_has_feature(X86_FEATURE_SHA_NI);
+
+	(void)argc;
+	(void)argv;
+
+	buf = malloc(BENCH_SIZE);
+	dest = malloc(BENCH_SIZE + 64);
+	if (!buf || !dest)
+		return 1;
+
+	/* xorshift, the kernels don't care what they hash */
+	for (i = 0; i < BENCH_SIZE; ++i) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		buf[i] = (uint8_t)x;
+	}
+
+	hide_sha_ni = TRUE;
+	if (!self_test()) {
+		printf("scalar: self test failed\n");
+		return 1;
+	}
+	if (!bench("scalar", dest, buf))
+		return 1;
+
+	hide_sha_ni = FALSE;
+	if (has_sha_ni) {
+		if (!self_test()) {
+			printf("sha-ni: self test failed\n");
+			return 1;
+		}
+		if (!bench("sha-ni", dest, buf))
+			return 1;
+	} else {
+		printf("sha-ni   not supported by this CPU\n");
+	}
+
+	free(dest);
+	free(buf);
+	return 0;
+}
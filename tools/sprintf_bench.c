@@ -0,0 +1,199 @@
+/*******************************************************************************
+* Copyright (c) 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+/*
+ * Host benchmark of vmm_vsprintf_s(), "make sprintf_bench". sprintf.c and
+ * string.c are built unchanged for the host. The integer conversions are
+ * first checked against the C library's snprintf() over values of every
+ * length and over every buffer size that cuts them off, then each format
+ * below, taken from lines the loader prints, is timed.
+ *
+ * The loader headers define their own fixed width types, so no libc
+ * header that defines them can be included here.
+ */
+#include <time.h>
+
+#include "string.h"
+
+int printf(const char *fmt, ...);
+int snprintf(char *buf, unsigned long size, const char *fmt, ...);
+int strcmp(const char *a, const char *b);
+
+#define BENCH_CALLS     2000000
+#define CHECK_VALUES    100000
+
+static uint64_t xorshift_state = 0x2545F4914F6CDD1DULL;
+
+static uint64_t xorshift(void)
+{
+	xorshift_state ^= xorshift_state << 13;
+	xorshift_state ^= xorshift_state >> 7;
+	xorshift_state ^= xorshift_state << 17;
+	return xorshift_state;
+}
+
+/* a value of random bit length, so every digit count comes up */
+static uint64_t random_value(void)
+{
+	uint64_t r = xorshift();
+
+	return r >> (xorshift() & 63);
+}
+
+static boolean_t same(const char *what, const char *got, const char *want)
+{
+	if (strcmp(got, want)) {
+		printf("%s: got \"%s\", want \"%s\"\n", what, got, want);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static boolean_t check_value(uint64_t v)
+{
+	/* vmm_sprintf_s() format, then the same in C */
+	static const struct {
+		const char *vmm;
+		const char *libc;
+		uint32_t is_32bit;
+	} formats[] = {
+		{ "%lu", "%llu", 0 },
+		{ "%ld", "%lld", 0 },
+		{ "%lx", "%llx", 0 },
+		{ "%lX", "%llX", 0 },
+		{ "%016lx", "%016llx", 0 },
+		{ "%24lu", "%24llu", 0 },
+		{ "%022ld", "%022lld", 0 },
+		{ "%p", "0x%08llx", 0 },
+		{ "%u", "%u", 1 },
+		{ "%d", "%d", 1 },
+		{ "%x", "%x", 1 },
+		{ "%08x", "%08x", 1 },
+		{ "%06d", "%06d", 1 },
+		{ "%12u", "%12u", 1 },
+	};
+	char got[64];
+	char want[64];
+	uint32_t size;
+	uint32_t i;
+
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+		for (size = 1; size <= 32; ++size) {
+			if (formats[i].is_32bit) {
+				vmm_sprintf_s(got, size, formats[i].vmm, (uint32_t)v);
+				snprintf(want, size, formats[i].libc, (uint32_t)v);
+			} else {
+				vmm_sprintf_s(got, size, formats[i].vmm, v);
+				snprintf(want, size, formats[i].libc, v);
+			}
+			if (!same(formats[i].vmm, got, want)) {
+				printf("value 0x%llx, buffer %u\n", v, size);
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static boolean_t self_test(void)
+{
+	static const uint64_t edges[] = {
+		0, 1, 9, 10, 99, 100, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFF,
+		0x100000000ULL, 9999999999999999999ULL, 10000000000000000000ULL,
+		0x7FFFFFFFFFFFFFFFULL, 0x8000000000000000ULL,
+		0xFFFFFFFFFFFFFFFFULL,
+	};
+	char got[64];
+	uint32_t i;
+
+	for (i = 0; i < sizeof(edges) / sizeof(edges[0]); ++i) {
+		if (!check_value(edges[i]) || !check_value(edges[i] - 1))
+			return FALSE;
+	}
+
+	for (i = 0; i < CHECK_VALUES; ++i) {
+		if (!check_value(random_value()))
+			return FALSE;
+	}
+
+	/* what sprintf.c does on its own */
+	vmm_sprintf_s(got, sizeof(got), "%s|%5s|%c|%%|%P\n", "abc", "strings",
+			'z', 0xABCULL);
+	return same("%s %c %% %P", got, "abc|strin|z|%|0x00000ABC\r\n");
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t sink;
+
+static void report(const char *name, double t, uint64_t bytes)
+{
+	printf("%-12s %7.1f ns/call %8.1f MB/s\n", name,
+			t * 1e9 / BENCH_CALLS, bytes / t / 1e6);
+}
+
+/* each case calls vmm_sprintf_s() BENCH_CALLS times with changing values */
+#define BENCH(name, ...) do { \
+	double start = now(); \
+	uint64_t bytes = 0; \
+	for (i = 0; i < BENCH_CALLS; ++i) { \
+		v = values[i & 1023]; \
+		bytes += vmm_sprintf_s(buf, sizeof(buf), __VA_ARGS__); \
+	} \
+	report(name, now() - start, bytes); \
+	sink += bytes + (uint8_t)buf[0]; \
+} while (0)
+
+int main(int argc, char **argv)
+{
+	static uint64_t values[1024];
+	char buf[256];
+	uint64_t v;
+	uint32_t i;
+
+	(void)argc;
+	(void)argv;
+
+	if (!self_test()) {
+		printf("self test failed\n");
+		return 1;
+	}
+	printf("self test passed\n");
+
+	for (i = 0; i < 1024; ++i)
+		values[i] = random_value();
+
+	BENCH("image", "trusty loader: image at 0x%lx, segments aligned to "
+			"0x%lx\n", v, v & 0x1FFFFF);
+	BENCH("timeline", "trusty loader: boot %lu%s: %s %lu%s/0x%lx, "
+			"TSC %lu kHz\n", v % 1000000, "us", "copy", v % 100000, "us",
+			v, (uint64_t)2112000);
+	BENCH("relocation", "trusty loader: R_X86_64_32 at 0x%lx overflows\n",
+			v);
+	BENCH("fifo", "trusty loader: UART FIFO %d bytes\n", (uint32_t)v & 127);
+	BENCH("digest", "%016lx%016lx%016lx%016lx", v, ~v, v >> 3, v << 5);
+	BENCH("decimal", "%lu %lu %lu %lu\n", v, v >> 16, v >> 32, v >> 48);
+	BENCH("pointer", "%p %P\n", v, v >> 8);
+
+	return (int)(sink & 0);
+}
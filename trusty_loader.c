@@ -17,120 +17,100 @@
 #include "elf_ld.h"
 #include "string.h"
 #include "util.h"
+#include "cpu.h"
+#include "paging.h"
+#include "package.h"
+#include "timeline.h"
+#include "hypercall.h"
+#include "platform.h"
+#include "boot_params.h"
+#include "cmdline.h"
 
-#define MULTIBOOT_HEADER_SIZE         32
+#define TRUSTY_RUNTIME_PAGES        16*1024
 
-//Macro must align to definition in acorn
-#define _HC_ID(x, y) (((x)<<24)|(y))
+#define CHECK_FLAG(flag,bit)	((flag) & (1 << (bit)))
 
-#define HC_ID 0x80UL
+/* TRUE if the module cmdline starts with the word name */
+static boolean_t module_is(const multiboot_module_t *mod, const char *name)
+{
+	const char *cmdline;
+	uint32_t i;
 
-#define HC_ID_TRUSTY_BASE           0x70UL
-#define HC_INITIALIZE_TRUSTY        _HC_ID(HC_ID, HC_ID_TRUSTY_BASE + 0x00UL)
+	if (!mod->cmdline)
+		return FALSE;
 
-#define TRUSTY_RUNTIME_PAGES        16*1024
-#define TRUSTY_RUNTIME_BASE         0x7FC0000000
-#define TRUSTY_RSVD_SIZE            0x1000
-#define TRUSTY_64BIT_ENTRY_OFFSET   0x400
+	cmdline = platform_mem(mod->cmdline, MAX_STR_LEN);
+	if (!cmdline)
+		return FALSE;
 
-#define CHECK_FLAG(flag,bit)	((flag) & (1 << (bit)))
+	for (i = 0; name[i]; ++i) {
+		if (cmdline[i] != name[i])
+			return FALSE;
+	}
+
+	return (cmdline[i] == '\0') || (cmdline[i] == ' ');
+}
 
-/*
- * Trusty boot params, used for HC_INITIALIZE_TRUSTY.
+/* vSBL places each module on its own, page aligned since the multiboot
+ * header sets flags[0]. a single unnamed module is taken as well.
  */
+static boolean_t module_find(multiboot_info_t *mbi, const char *name,
+		uint64_t *base, uint64_t *size)
+{
+	const multiboot_module_t *mods;
+	const multiboot_module_t *found = NULL;
+	uint32_t i;
+
+	if (!CHECK_FLAG(mbi->flags, 3) || (0 == mbi->mods_count)) {
+		printf("trusty loader: multiboot info has no modules\n");
+		return FALSE;
+	}
+
+	mods = platform_mem(mbi->mods_addr,
+			mbi->mods_count * sizeof(multiboot_module_t));
+	if (!mods) {
+		printf("trusty loader: multiboot modules at 0x%x out of reach\n",
+				mbi->mods_addr);
+		return FALSE;
+	}
+
+	for (i = 0; i < mbi->mods_count; ++i) {
+		if (module_is(&mods[i], name)) {
+			found = &mods[i];
+			break;
+		}
+	}
+
+	if (!found && (1 == mbi->mods_count))
+		found = &mods[0];
+
+	if (!found || (found->mod_end <= found->mod_start)) {
+		printf("trusty loader: no %s module in %d modules\n", name,
+				mbi->mods_count);
+		return FALSE;
+	}
+
+	*base = found->mod_start;
+	*size = found->mod_end - found->mod_start;
+	if (!platform_mem(*base, *size)) {
+		printf("trusty loader: %s module at 0x%lx out of reach\n", name,
+				*base);
+		return FALSE;
+	}
+
+	printf("trusty loader: %s module at 0x%lx, 0x%lx bytes\n", name,
+			*base, *size);
+	return TRUE;
+}
 
-typedef struct {
-    uint32_t size_of_struct;    /* sizeof this structure */
-    uint32_t version;           /* version of this structure */
-    uint32_t base_addr;         /* trusty runtime memory base address */
-    uint32_t entry_point;       /* trusty entry point */
-    uint32_t mem_size;          /* trusty runtime memory size */
-    uint32_t padding;           /* padding */
-    uint32_t base_addr_high;    /* trusty runtime memory base address (high 32bit) */
-    uint32_t entry_point_high;  /* trusty entry point (high 32bit) */
-    uint8_t  rpmb_key[64];      /* rpmb key */
-} trusty_boot_param_t;
-
-/* arguments parsed from cmdline */
-typedef struct {
-	uint32_t size_of_struct;
-    uint32_t version;
-    uint64_t seedlist_info_addr;
-    uint64_t platform_info_addr;
-    uint64_t vmm_boot_param_addr;
-} image_boot_param_t;
-
-/* Linux boot cpu sate */
-typedef struct {
-  uint32_t eip;
-  uint32_t eax;
-  uint32_t ebx;
-  uint32_t esi;
-  uint32_t edi;
-  uint32_t ecx;
-} cpu_boot_state_t;
-
-/* Linux boot params, used for linux launch */
-typedef struct {
-  uint32_t size_of_struct;
-  uint32_t version;
-  cpu_boot_state_t cpu_state;
-} linux_boot_param_t;
-
-
-/* a.out kernel image */
-typedef struct {
-	uint32_t tabsize;
-	uint32_t strsize;
-	uint32_t addr;
-	uint32_t reserved;
-} aout_t;
-
-/* elf kernel */
-typedef struct {
-	uint32_t num;
-	uint32_t size;
-	uint32_t addr;
-	uint32_t shndx;
-} elf_t;
-
-/* only used partial of the standard multiboot_info_t */
-typedef struct {
-	uint32_t flags;
-
-	/* valid if flags[0] (MBI_MEMLIMITS) set */
-	uint32_t mem_lower;
-	uint32_t mem_upper;
-
-	/* valid if flags[1] set */
-	uint32_t boot_device;
-
-	/* valid if flags[2] (MBI_CMDLINE) set */
-	uint32_t cmdline;
-
-	/* valid if flags[3] (MBI_MODS) set */
-	uint32_t mods_count;
-	uint32_t mods_addr;
-
-	/* valid if flags[4] or flags[5] set */
-	union {
-		aout_t aout_image;
-		elf_t elf_image;
-	} syms;
-
-	/* valid if flags[6] (MBI_MEMMAP) set */
-	uint32_t mmap_length;
-	uint32_t mmap_addr;
-} multiboot_info_t;
-
-static boolean_t cmdline_parse(multiboot_info_t *mbi, uint64_t *boot_param_addr)
+/* split the cmdline into params, and find the image boot params in it */
+static boolean_t cmdline_parse(multiboot_info_t *mbi, cmdline_t *params,
+		uint64_t *boot_param_addr)
 {
-    const char *cmdline;
-	const char *arg;
-	const char *param;
-	uint32_t addr;
+	const char *cmdline;
+	uint64_t addr;
 
-	if (!mbi || !boot_param_addr)
+	if (!mbi || !params || !boot_param_addr)
 		return FALSE;
 
 	if (!CHECK_FLAG(mbi->flags, 2)) {
@@ -138,123 +118,244 @@ static boolean_t cmdline_parse(multiboot_info_t *mbi, uint64_t *boot_param_addr)
 		return FALSE;
 	}
 
-	cmdline = (const char *)(uint64_t)mbi->cmdline;
+	cmdline = platform_mem(mbi->cmdline, MAX_STR_LEN);
+	if (!cmdline)
+		return FALSE;
 
-    /* Parse ImageBootParamsAddr */
 	printf("cmdline from vSBL: %s\n", cmdline);
-	arg = strstr_s(cmdline, MAX_STR_LEN, "ImageBootParamsAddr=",
-            sizeof("ImageBootParamsAddr=")-1);
+	cmdline_init(params, cmdline, MAX_STR_LEN);
 
-	if (!arg) {
+	if (!cmdline_find(params, "ImageBootParamsAddr")) {
 		printf("trusty loader: ImageBootParamsAddr not found in cmdline!\n");
 		return FALSE;
 	}
 
-	param = arg + sizeof("ImageBootParamsAddr=") - 1;
-
-	addr = str2uint(param, 18, NULL, 16);
-	if ((addr == (uint32_t)-1) ||
-		(addr == 0)) {
+	if (!cmdline_get_u64(params, "ImageBootParamsAddr", 16, &addr) ||
+			(0 == addr)) {
 		printf("trusty loader: failed to parse ImageBootParamsAddr!\n");
 		return FALSE;
 	}
-	*boot_param_addr = (uint64_t)addr;
+	*boot_param_addr = addr;
 
-    return TRUE;
+	return TRUE;
 }
 
-static int launch_trusty(trusty_boot_param_t *param)
+/* the trusty module, or the package tools/mkpkg.py appended to the
+ * loader. in a package the image called TRUSTY_MODULE_NAME is taken and
+ * *digest set to its entry's measurement, if it has one.
+ */
+static boolean_t image_find(multiboot_info_t *mbi, uint64_t trusty_loader_base,
+		uint64_t *base, uint64_t *size, const uint8_t **digest)
 {
-    int ret = TRUE;
+	uint32_t pkg_offset = *(uint32_t *)(trusty_loader_base +
+			TRUSTY_PKG_OFFSET_OFFSET);
+	const trusty_pkg_image_t *image;
 
-    register uint64_t hypercall_id __asm__("r8") = HC_INITIALIZE_TRUSTY;
+	if (!module_find(mbi, TRUSTY_MODULE_NAME, base, size)) {
+		if (0 == pkg_offset)
+			return FALSE;
 
+		*base = trusty_loader_base + pkg_offset;
+		*size = ((trusty_pkg_hdr_t *)*base)->size;
+		printf("trusty loader: package in the loader at 0x%lx\n", *base);
+	}
+
+	*digest = NULL;
+	if (TRUSTY_PKG_MAGIC != *(uint32_t *)*base)
+		return TRUE;
+
+	if (!package_find(*base, *size, TRUSTY_MODULE_NAME, &image))
+		return FALSE;
+
+	*base += image->offset;
+	*size = image->size;
+	if (image->flags & TRUSTY_PKG_MEASURED)
+		*digest = image->digest;
+
+	printf("trusty loader: package image %s at 0x%lx, 0x%lx bytes\n",
+			TRUSTY_MODULE_NAME, *base, *size);
+	return TRUE;
+}
+
+static int launch_trusty(trusty_boot_param_t *param)
+{
     if (!param)
         return FALSE;
 
-    __asm__ __volatile__ (
-        "vmcall;"
-        : "=a" (ret)
-        : "r" (hypercall_id), "D" ((uint64_t)param)
-        : "memory");
-
-    return ret;
+    return (int)platform_hypercall(HC_INITIALIZE_TRUSTY, (uint64_t)param);
 }
 
-static void launch_linux(uint64_t boot_param_addr)
+/* returns only if the Linux boot params can't be reached. start is the
+ * TSC when trusty came back from the hypercall, the handoff span runs from
+ * there to the UART flush right before the jump */
+static void launch_linux(const image_boot_param_t *image_boot_params,
+        uint64_t start)
 {
-    image_boot_param_t *image_boot_params = (image_boot_param_t *)boot_param_addr;
-    linux_boot_param_t *linux_boot_params = (linux_boot_param_t *)
-        (image_boot_params->vmm_boot_param_addr);
-    cpu_boot_state_t *cpu_state = &(linux_boot_params->cpu_state);
-    uint64_t rip = cpu_state->eip;
-    uint64_t rax = cpu_state->eax;
-    uint64_t rbx = cpu_state->ebx;
-    uint64_t rsi = cpu_state->esi;
-    uint64_t rdi = cpu_state->edi;
-    uint64_t rcx = cpu_state->ecx;
-
-    printf("trusty loader linux entry point is 0x%lx\n", rip);
-
-    __asm__ __volatile__ ("cli\n\t" 
-                          "movq %1, %%rax\n\t"
-                          "movq %2, %%rbx\n\t"
-                          "movq %3, %%rsi\n\t"
-                          "movq %4, %%rdi\n\t"
-                          "movq %5, %%rcx\n\t"
-                          "jmp *%0\n\t"
-						  : 
-                          : "m" (rip),
-                          "m" (rax),
-                          "m" (rbx),
-                          "m" (rsi),
-                          "m" (rdi),
-                          "m" (rcx));
+    const linux_boot_param_t *linux_boot_params;
+    const cpu_boot_state_t *cpu_state;
+    const log_ring_t *log = print_log_ring();
+
+    linux_boot_params = platform_mem(image_boot_params->vmm_boot_param_addr,
+            sizeof(linux_boot_param_t));
+    if (!linux_boot_params) {
+        printf("trusty loader: linux boot params at 0x%lx out of reach\n",
+                image_boot_params->vmm_boot_param_addr);
+        return;
+    }
+    cpu_state = &(linux_boot_params->cpu_state);
+
+    printf("trusty loader linux entry point is 0x%x\n", cpu_state->eip);
+    printf("trusty loader: log ring at 0x%lx, 0x%lx bytes written\n",
+            (uint64_t)log, log->head);
+
+    timeline_add(TL_HANDOFF, start, 0);
+    timeline_print();
+
+    /* the log reaches the UART only now, off the boot critical path */
+    print_flush();
+
+    platform_launch_linux(cpu_state->eip, cpu_state->eax, cpu_state->ebx,
+            cpu_state->esi, cpu_state->edi, cpu_state->ecx);
 }
 
 void trusty_loader_main(uint64_t *multiboot_info, uint64_t trusty_loader_base)
 {
     trusty_boot_param_t param;
     multiboot_info_t *mbi = (multiboot_info_t *)multiboot_info;
-    uint64_t trusty_loadtime_addr = *((uint32_t *)(trusty_loader_base +
-                MULTIBOOT_HEADER_SIZE)) * 512;
+    uint64_t trusty_loadtime_addr;
+    uint64_t trusty_image_size;
     uint64_t trusty_runtime_addr = TRUSTY_RUNTIME_BASE + TRUSTY_RSVD_SIZE;
     uint64_t trusty_run_entry;
     uint64_t boot_param_addr;
-
+    static cmdline_t params;    /* in the bss, not on the 2K stack */
+    image_boot_param_t *image_boot_params;
+    elf_load_info_t load_info;
+    const uint8_t *digest = (const uint8_t *)(trusty_loader_base +
+                TRUSTY_IMAGE_DIGEST_OFFSET);
+    const uint8_t *pkg_digest;
+    uint64_t t;
+    uint32_t i;
+
+    timeline_init();
     print_init();
 
     printf("trusty loader start\n");
 
+    /* enable SSE/AVX for the loader's copy and zero kernels */
+    cpu_init();
+    util_init(cpu_simd_level());
+
     memset((void *)&param, 0, sizeof(trusty_boot_param_t));
+    memset((void *)&load_info, 0, sizeof(elf_load_info_t));
 
-    if (!cmdline_parse(mbi, &boot_param_addr)) {
-        printf("trusty loader: cmdline parse failed");
+    t = rdtsc();
+    if (!cmdline_parse(mbi, &params, &boot_param_addr)) {
+        printf("trusty loader: cmdline parse failed\n");
         goto fail;
     }
+    t = timeline_add(TL_CMDLINE, t, 0);
 
-    if (!relocate_elf_image(trusty_loadtime_addr, trusty_runtime_addr,
-                &trusty_run_entry)) {
+    if (!image_find(mbi, trusty_loader_base, &trusty_loadtime_addr,
+                &trusty_image_size, &pkg_digest)) {
+        printf("trusty loader: trusty image not found\n");
+        goto fail;
+    }
+    timeline_add(TL_VALIDATE, t, trusty_image_size);
+
+    image_boot_params = platform_mem(boot_param_addr,
+            sizeof(image_boot_param_t));
+    if (!image_boot_params) {
+        printf("trusty loader: boot params at 0x%lx out of reach\n",
+                boot_param_addr);
+        goto fail;
+    }
+    if (image_boot_params->size_of_struct >= sizeof(image_boot_param_t)) {
+        load_info.zeroed_base = image_boot_params->zeroed_mem_base;
+        load_info.zeroed_size = image_boot_params->zeroed_mem_size;
+    }
+
+    /* an all zero digest was never filled in by tools/measure.py */
+    for (i = 0; i < SHA256_DIGEST_SIZE; ++i) {
+        if (digest[i]) {
+            load_info.expected_digest = digest;
+            break;
+        }
+    }
+    printf("trusty loader: image is %smeasured\n",
+            load_info.expected_digest ? "" : "not ");
+
+    /* the package's own digest vouches for nothing, it still catches an
+     * image damaged on its way to memory */
+    if (!load_info.expected_digest && pkg_digest) {
+        load_info.expected_digest = pkg_digest;
+        printf("trusty loader: image is checked against the package\n");
+    }
+
+    if (!platform_mem(TRUSTY_RUNTIME_BASE, TRUSTY_RUNTIME_TOTAL_SIZE)) {
+        printf("trusty loader: trusty memory out of reach\n");
+        goto fail;
+    }
+
+    /* what vSBL left us, then load on write-back large pages */
+    paging_report("image", trusty_loadtime_addr);
+    paging_report("runtime", trusty_runtime_addr);
+    if (paging_init(TRUSTY_RUNTIME_BASE, TRUSTY_RUNTIME_TOTAL_SIZE))
+        paging_enter();
+
+    if (!relocate_elf_image(trusty_loadtime_addr, trusty_image_size,
+                trusty_runtime_addr, &trusty_run_entry, &load_info)) {
 		printf("trusty loader: relocate trusty failed\n");
 		goto fail;
 	}
 
+    paging_leave();
+
+    printf("trusty loader: copied 0x%lx, mapped 0x%lx, zeroed 0x%lx, "
+            "zeroing skipped 0x%lx bytes\n", load_info.copied_bytes,
+            load_info.remapped_bytes, load_info.zeroed_bytes,
+            load_info.zero_skipped_bytes);
+
+    for (i = 0; i < load_info.segment_count; ++i) {
+        printf("trusty loader: segment 0x%lx+0x%lx flags 0x%x\n",
+                load_info.segments[i].base, load_info.segments[i].size,
+                load_info.segments[i].flags);
+    }
+
+    if (load_info.load_base + load_info.load_size >
+            TRUSTY_RUNTIME_BASE + TRUSTY_MEM_SIZE) {
+        printf("trusty loader: image ends at 0x%lx, past the 0x%x bytes of "
+                "trusty memory\n", load_info.load_base + load_info.load_size,
+                TRUSTY_MEM_SIZE);
+        goto fail;
+    }
+
     // Fill in parameters
-    param.size_of_struct   = sizeof(trusty_boot_param_t);
-    param.mem_size         = 16 MEGABYTE;
-    param.version          = 2;
+    param.size_of_struct   = TRUSTY_BOOT_PARAM_SIZE;
+    param.mem_size         = TRUSTY_MEM_SIZE;
+    param.version          = TRUSTY_BOOT_PARAM_VERSION;
     param.base_addr        = (uint32_t)((TRUSTY_RUNTIME_BASE) & 0xFFFFFFFF);
     param.base_addr_high   = (uint32_t)((TRUSTY_RUNTIME_BASE >> 32) & 0xFFFFFFFF);
     param.entry_point      = (uint32_t)((trusty_run_entry +
                 TRUSTY_64BIT_ENTRY_OFFSET) & 0xFFFFFFFF);
     param.entry_point_high = (uint32_t)(((trusty_run_entry +
                 TRUSTY_64BIT_ENTRY_OFFSET) >> 32) & 0xFFFFFFFF);
+    param.load_base        = load_info.load_base;
+    param.segment_count    = load_info.segment_count;
+    memcpy(param.segments, load_info.segments,
+            load_info.segment_count * sizeof(elf_segment_info_t));
 
+    t = rdtsc();
     launch_trusty(&param);
+    t = timeline_add(TL_HYPERCALL, t, param.size_of_struct);
 
-    launch_linux(boot_param_addr);
+    /* hand the FPU/XSAVE state back to Linux the way vSBL set it up */
+    util_init(SIMD_NONE);
+    cpu_restore();
+    launch_linux(image_boot_params, t);
 
 fail:
+    timeline_print();
 	printf("trusty loader: deadloop!\n");
-	__STOP_HERE__;
+	print_flush();
+	platform_halt();
 }
@@ -27,6 +27,4 @@
 /* The flags for the Multiboot header (non-ELF) */
 #define MULTIBOOT_HEADER_FLAGS          0x00010003
 
-#define TRUSTY_LOAD_ADDR_MAGIC          0xF
-
 #endif
@@ -29,6 +29,7 @@ typedef unsigned char uint8_t;
 typedef unsigned short uint16_t;
 typedef unsigned int uint32_t;
 typedef unsigned long long uint64_t;
+typedef int int32_t;
 typedef uint32_t boolean_t;
 typedef struct {
 	uint64_t uint64[2];
@@ -52,6 +53,10 @@ typedef struct {
 #define PAGE_4K_SIZE 		(4 KILOBYTE)
 #define PAGE_4K_MASK 		(PAGE_4K_SIZE - 1)
 #define PAGE_ALIGN_4K(x)    ALIGN_F(x, PAGE_4K_SIZE)
+#define PAGE_2M_SIZE 		(2 MEGABYTE)
+#define PAGE_2M_MASK 		(PAGE_2M_SIZE - 1)
+#define PAGE_ALIGN_2M(x)    ALIGN_F(x, PAGE_2M_SIZE)
+
 /* Returns number of pages (4KB) required to accomdate x bytes */
 #define PAGE_4K_ROUNDUP(x)  (((x) + PAGE_4K_SIZE - 1) >> PAGE_4K_SHIFT)
 
@@ -14,39 +14,498 @@
 * limitations under the License.
 *******************************************************************************/
 #include "util.h"
+#include "cpu.h"
+
+/* below this size "rep movsb" start-up cost dominates anyway, so there is
+ * no point aligning the destination first.
+ */
+#define COPY_SMALL_SIZE     64
+
+/* below this size the vector kernels don't pay off their head/tail work */
+#define SIMD_MIN_SIZE       512
+
+/* from this size on memcpy_stream()/memset_stream() use non-temporal stores,
+ * smaller ranges are likely to fit in the cache and to be read back soon.
+ * "memcpy_bench -s" on a host with a 300 MB L3 had cached stores up to
+ * twice as fast through 16 MB, still ahead at 32 MB, and streaming ahead
+ * only at 64 MB, so by default nothing in the 16 MB of trusty memory is
+ * streamed. Where the bench finds the crossover lower, as on a target
+ * whose last level cache is smaller than the image, build with
+ * -DSTREAM_MIN_SIZE (Makefile).
+ */
+#ifndef STREAM_MIN_SIZE
+#define STREAM_MIN_SIZE     (64 MEGABYTE)
+#endif
+
+/* The vector kernels below are written in inline asm because the loader is
+ * built with -mno-sse, so the compiler never allocates vector registers and
+ * they need not (and can not) be listed as clobbers. Each kernel moves
+ * "blocks" units of 4 vector registers, blocks must not be 0, and dest must
+ * be aligned to the vector width.
+ */
+typedef void (*block_copy_t)(uint8_t *dest, const uint8_t *src, uint64_t blocks);
+typedef void (*block_zero_t)(uint8_t *dest, uint64_t blocks);
+
+/* selected by util_init(), all NULL means scalar code only */
+static struct {
+	uint64_t     vec_size;
+	block_copy_t copy;
+	block_zero_t zero;
+	block_copy_t stream_copy;
+	block_zero_t stream_zero;
+} simd_ops;
+
+static void copy_sse2(uint8_t *dest, const uint8_t *src, uint64_t blocks)
+{
+	__asm__ __volatile__ (
+		"1:                           \n\t"
+		"movdqu    (%1), %%xmm0       \n\t"
+		"movdqu  16(%1), %%xmm1       \n\t"
+		"movdqu  32(%1), %%xmm2       \n\t"
+		"movdqu  48(%1), %%xmm3       \n\t"
+		"movdqa  %%xmm0,   (%0)       \n\t"
+		"movdqa  %%xmm1, 16(%0)       \n\t"
+		"movdqa  %%xmm2, 32(%0)       \n\t"
+		"movdqa  %%xmm3, 48(%0)       \n\t"
+		"addq    $64, %1              \n\t"
+		"addq    $64, %0              \n\t"
+		"decq    %2                   \n\t"
+		"jnz     1b                   \n\t"
+		: "+r" (dest), "+r" (src), "+r" (blocks)
+		:: "cc", "memory");
+}
+
+static void zero_sse2(uint8_t *dest, uint64_t blocks)
+{
+	__asm__ __volatile__ (
+		"pxor    %%xmm0, %%xmm0       \n\t"
+		"1:                           \n\t"
+		"movdqa  %%xmm0,   (%0)       \n\t"
+		"movdqa  %%xmm0, 16(%0)       \n\t"
+		"movdqa  %%xmm0, 32(%0)       \n\t"
+		"movdqa  %%xmm0, 48(%0)       \n\t"
+		"addq    $64, %0              \n\t"
+		"decq    %1                   \n\t"
+		"jnz     1b                   \n\t"
+		: "+r" (dest), "+r" (blocks)
+		:: "cc", "memory");
+}
+
+static void copy_avx2(uint8_t *dest, const uint8_t *src, uint64_t blocks)
+{
+	__asm__ __volatile__ (
+		"1:                           \n\t"
+		"vmovdqu    (%1), %%ymm0      \n\t"
+		"vmovdqu  32(%1), %%ymm1      \n\t"
+		"vmovdqu  64(%1), %%ymm2      \n\t"
+		"vmovdqu  96(%1), %%ymm3      \n\t"
+		"vmovdqa  %%ymm0,   (%0)      \n\t"
+		"vmovdqa  %%ymm1, 32(%0)      \n\t"
+		"vmovdqa  %%ymm2, 64(%0)      \n\t"
+		"vmovdqa  %%ymm3, 96(%0)      \n\t"
+		"addq     $128, %1            \n\t"
+		"addq     $128, %0            \n\t"
+		"decq     %2                  \n\t"
+		"jnz      1b                  \n\t"
+		"vzeroupper                   \n\t"
+		: "+r" (dest), "+r" (src), "+r" (blocks)
+		:: "cc", "memory");
+}
+
+static void zero_avx2(uint8_t *dest, uint64_t blocks)
+{
+	__asm__ __volatile__ (
+		"vpxor    %%ymm0, %%ymm0, %%ymm0 \n\t"
+		"1:                           \n\t"
+		"vmovdqa  %%ymm0,   (%0)      \n\t"
+		"vmovdqa  %%ymm0, 32(%0)      \n\t"
+		"vmovdqa  %%ymm0, 64(%0)      \n\t"
+		"vmovdqa  %%ymm0, 96(%0)      \n\t"
+		"addq     $128, %0            \n\t"
+		"decq     %1                  \n\t"
+		"jnz      1b                  \n\t"
+		"vzeroupper                   \n\t"
+		: "+r" (dest), "+r" (blocks)
+		:: "cc", "memory");
+}
+
+static void copy_avx512(uint8_t *dest, const uint8_t *src, uint64_t blocks)
+{
+	__asm__ __volatile__ (
+		"1:                           \n\t"
+		"vmovdqu64     (%1), %%zmm0   \n\t"
+		"vmovdqu64   64(%1), %%zmm1   \n\t"
+		"vmovdqu64  128(%1), %%zmm2   \n\t"
+		"vmovdqu64  192(%1), %%zmm3   \n\t"
+		"vmovdqa64  %%zmm0,    (%0)   \n\t"
+		"vmovdqa64  %%zmm1,  64(%0)   \n\t"
+		"vmovdqa64  %%zmm2, 128(%0)   \n\t"
+		"vmovdqa64  %%zmm3, 192(%0)   \n\t"
+		"addq       $256, %1          \n\t"
+		"addq       $256, %0          \n\t"
+		"decq       %2                \n\t"
+		"jnz        1b                \n\t"
+		"vzeroupper                   \n\t"
+		: "+r" (dest), "+r" (src), "+r" (blocks)
+		:: "cc", "memory");
+}
+
+static void zero_avx512(uint8_t *dest, uint64_t blocks)
+{
+	__asm__ __volatile__ (
+		"vpxorq     %%zmm0, %%zmm0, %%zmm0 \n\t"
+		"1:                           \n\t"
+		"vmovdqa64  %%zmm0,    (%0)   \n\t"
+		"vmovdqa64  %%zmm0,  64(%0)   \n\t"
+		"vmovdqa64  %%zmm0, 128(%0)   \n\t"
+		"vmovdqa64  %%zmm0, 192(%0)   \n\t"
+		"addq       $256, %0          \n\t"
+		"decq       %1                \n\t"
+		"jnz        1b                \n\t"
+		"vzeroupper                   \n\t"
+		: "+r" (dest), "+r" (blocks)
+		:: "cc", "memory");
+}
+
+/* non-temporal kernels, the source is prefetched 512 bytes ahead so the
+ * loads overlap with the write-combining stores.
+ */
+static void stream_copy_sse2(uint8_t *dest, const uint8_t *src, uint64_t blocks)
+{
+	__asm__ __volatile__ (
+		"1:                           \n\t"
+		"prefetchnta 512(%1)          \n\t"
+		"movdqu    (%1), %%xmm0       \n\t"
+		"movdqu  16(%1), %%xmm1       \n\t"
+		"movdqu  32(%1), %%xmm2       \n\t"
+		"movdqu  48(%1), %%xmm3       \n\t"
+		"movntdq %%xmm0,   (%0)       \n\t"
+		"movntdq %%xmm1, 16(%0)       \n\t"
+		"movntdq %%xmm2, 32(%0)       \n\t"
+		"movntdq %%xmm3, 48(%0)       \n\t"
+		"addq    $64, %1              \n\t"
+		"addq    $64, %0              \n\t"
+		"decq    %2                   \n\t"
+		"jnz     1b                   \n\t"
+		: "+r" (dest), "+r" (src), "+r" (blocks)
+		:: "cc", "memory");
+}
+
+static void stream_zero_sse2(uint8_t *dest, uint64_t blocks)
+{
+	__asm__ __volatile__ (
+		"pxor    %%xmm0, %%xmm0       \n\t"
+		"1:                           \n\t"
+		"movntdq %%xmm0,   (%0)       \n\t"
+		"movntdq %%xmm0, 16(%0)       \n\t"
+		"movntdq %%xmm0, 32(%0)       \n\t"
+		"movntdq %%xmm0, 48(%0)       \n\t"
+		"addq    $64, %0              \n\t"
+		"decq    %1                   \n\t"
+		"jnz     1b                   \n\t"
+		: "+r" (dest), "+r" (blocks)
+		:: "cc", "memory");
+}
+
+static void stream_copy_avx2(uint8_t *dest, const uint8_t *src, uint64_t blocks)
+{
+	__asm__ __volatile__ (
+		"1:                           \n\t"
+		"prefetchnta 512(%1)          \n\t"
+		"prefetchnta 576(%1)          \n\t"
+		"vmovdqu    (%1), %%ymm0      \n\t"
+		"vmovdqu  32(%1), %%ymm1      \n\t"
+		"vmovdqu  64(%1), %%ymm2      \n\t"
+		"vmovdqu  96(%1), %%ymm3      \n\t"
+		"vmovntdq %%ymm0,   (%0)      \n\t"
+		"vmovntdq %%ymm1, 32(%0)      \n\t"
+		"vmovntdq %%ymm2, 64(%0)      \n\t"
+		"vmovntdq %%ymm3, 96(%0)      \n\t"
+		"addq     $128, %1            \n\t"
+		"addq     $128, %0            \n\t"
+		"decq     %2                  \n\t"
+		"jnz      1b                  \n\t"
+		"vzeroupper                   \n\t"
+		: "+r" (dest), "+r" (src), "+r" (blocks)
+		:: "cc", "memory");
+}
+
+static void stream_zero_avx2(uint8_t *dest, uint64_t blocks)
+{
+	__asm__ __volatile__ (
+		"vpxor    %%ymm0, %%ymm0, %%ymm0 \n\t"
+		"1:                           \n\t"
+		"vmovntdq %%ymm0,   (%0)      \n\t"
+		"vmovntdq %%ymm0, 32(%0)      \n\t"
+		"vmovntdq %%ymm0, 64(%0)      \n\t"
+		"vmovntdq %%ymm0, 96(%0)      \n\t"
+		"addq     $128, %0            \n\t"
+		"decq     %1                  \n\t"
+		"jnz      1b                  \n\t"
+		"vzeroupper                   \n\t"
+		: "+r" (dest), "+r" (blocks)
+		:: "cc", "memory");
+}
+
+static void stream_copy_avx512(uint8_t *dest, const uint8_t *src, uint64_t blocks)
+{
+	__asm__ __volatile__ (
+		"1:                           \n\t"
+		"prefetchnta 512(%1)          \n\t"
+		"prefetchnta 576(%1)          \n\t"
+		"prefetchnta 640(%1)          \n\t"
+		"prefetchnta 704(%1)          \n\t"
+		"vmovdqu64     (%1), %%zmm0   \n\t"
+		"vmovdqu64   64(%1), %%zmm1   \n\t"
+		"vmovdqu64  128(%1), %%zmm2   \n\t"
+		"vmovdqu64  192(%1), %%zmm3   \n\t"
+		"vmovntdq   %%zmm0,    (%0)   \n\t"
+		"vmovntdq   %%zmm1,  64(%0)   \n\t"
+		"vmovntdq   %%zmm2, 128(%0)   \n\t"
+		"vmovntdq   %%zmm3, 192(%0)   \n\t"
+		"addq       $256, %1          \n\t"
+		"addq       $256, %0          \n\t"
+		"decq       %2                \n\t"
+		"jnz        1b                \n\t"
+		"vzeroupper                   \n\t"
+		: "+r" (dest), "+r" (src), "+r" (blocks)
+		:: "cc", "memory");
+}
+
+static void stream_zero_avx512(uint8_t *dest, uint64_t blocks)
+{
+	__asm__ __volatile__ (
+		"vpxorq     %%zmm0, %%zmm0, %%zmm0 \n\t"
+		"1:                           \n\t"
+		"vmovntdq   %%zmm0,    (%0)   \n\t"
+		"vmovntdq   %%zmm0,  64(%0)   \n\t"
+		"vmovntdq   %%zmm0, 128(%0)   \n\t"
+		"vmovntdq   %%zmm0, 192(%0)   \n\t"
+		"addq       $256, %0          \n\t"
+		"decq       %1                \n\t"
+		"jnz        1b                \n\t"
+		"vzeroupper                   \n\t"
+		: "+r" (dest), "+r" (blocks)
+		:: "cc", "memory");
+}
+
+void util_init(uint32_t simd_level)
+{
+	switch (simd_level) {
+		case SIMD_AVX512:
+			simd_ops.vec_size = 64;
+			simd_ops.copy = copy_avx512;
+			simd_ops.zero = zero_avx512;
+			simd_ops.stream_copy = stream_copy_avx512;
+			simd_ops.stream_zero = stream_zero_avx512;
+			break;
+		case SIMD_AVX2:
+			simd_ops.vec_size = 32;
+			simd_ops.copy = copy_avx2;
+			simd_ops.zero = zero_avx2;
+			simd_ops.stream_copy = stream_copy_avx2;
+			simd_ops.stream_zero = stream_zero_avx2;
+			break;
+		case SIMD_SSE2:
+			simd_ops.vec_size = 16;
+			simd_ops.copy = copy_sse2;
+			simd_ops.zero = zero_sse2;
+			simd_ops.stream_copy = stream_copy_sse2;
+			simd_ops.stream_zero = stream_zero_sse2;
+			break;
+		default:
+			simd_ops.vec_size = 0;
+			simd_ops.copy = NULL;
+			simd_ops.zero = NULL;
+			simd_ops.stream_copy = NULL;
+			simd_ops.stream_zero = NULL;
+			break;
+	}
+}
 
 /* with tests we found that, using "stosb" to set 1 page is
  * a little bit quicker than "stosq" in most cases
  */
-void memset(void *dest, uint8_t val, uint64_t count)
+static void set_bytes(void *dest, uint8_t val, uint64_t count)
 {
 	__asm__ __volatile__ (
 		"cld        \n\t"
 		"rep stosb  \n\t"
-		:: "D" (dest), "a" (val), "c" (count)
-		);
+		: "+D" (dest), "+c" (count)
+		: "a" (val)
+		: "memory");
 	return;
 }
 
-/* with tests we found that, using "movsb" to copy 1 page is
- * a little bit quicker than "movsq" in most cases
+/* zero the vector aligned bulk of [dest, dest + count) with the given
+ * kernel, the unaligned head and the tail are left to the caller's
+ * scalar code. returns the number of bytes consumed from the start.
  */
-void memcpy(void *dest, const void *src, uint64_t count)
+static uint64_t zero_bulk(uint8_t *dest, uint64_t count, block_zero_t kernel)
+{
+	uint64_t block_size = simd_ops.vec_size * 4;
+	uint64_t head = (0 - (uint64_t)dest) & (simd_ops.vec_size - 1);
+	uint64_t blocks = (count - head) / block_size;
+
+	set_bytes(dest, 0, head);
+	if (blocks)
+		kernel(dest + head, blocks);
+
+	return head + blocks * block_size;
+}
+
+void memset(void *dest, uint8_t val, uint64_t count)
 {
-	if (dest < src) {
+	uint8_t *d = (uint8_t *)dest;
+	uint64_t done = 0;
+
+	if ((val == 0) && simd_ops.zero && (count >= SIMD_MIN_SIZE))
+		done = zero_bulk(d, count, simd_ops.zero);
+
+	set_bytes(d + done, val, count - done);
+}
+
+static void copy_forward(uint8_t *dest, const uint8_t *src, uint64_t count,
+		block_copy_t kernel)
+{
+	uint64_t head;
+	uint64_t qwords;
+	uint64_t blocks, block_size;
+
+	if (kernel && (count >= SIMD_MIN_SIZE)) {
+		block_size = simd_ops.vec_size * 4;
+		head = (0 - (uint64_t)dest) & (simd_ops.vec_size - 1);
+		count -= head;
 		__asm__ __volatile__ (
 			"cld        \n\t"
 			"rep movsb  \n\t"
-			:: "D" (dest), "S" (src), "c" (count)
-			);
-	}else {
+			: "+D" (dest), "+S" (src), "+c" (head)
+			:: "memory");
+
+		blocks = count / block_size;
+		if (blocks)
+			kernel(dest, src, blocks);
+		dest += blocks * block_size;
+		src += blocks * block_size;
+		count -= blocks * block_size;
+	}
+
+	if (count >= COPY_SMALL_SIZE) {
+		/* byte copy up to 8-byte aligned destination, so that the
+		 * "movsq" stores below never split a cache line.
+		 */
+		head = (0 - (uint64_t)dest) & 7;
+		qwords = (count - head) >> 3;
+		count = (count - head) & 7;
+
 		__asm__ __volatile__ (
-			"std        \n\t"
-			"rep movsb  \n\t"
 			"cld        \n\t"
-			:: "D" ((uint64_t)dest + count - 1), "S" ((uint64_t)src + count - 1), "c" (count)
-			);
+			"rep movsb  \n\t"
+			"movq %3, %%rcx \n\t"
+			"rep movsq  \n\t"
+			: "+D" (dest), "+S" (src), "+c" (head)
+			: "r" (qwords)
+			: "memory");
 	}
-	return;
+
+	/* small copy, or the tail of a large one */
+	__asm__ __volatile__ (
+		"cld        \n\t"
+		"rep movsb  \n\t"
+		: "+D" (dest), "+S" (src), "+c" (count)
+		:: "memory");
+}
+
+/* only used when dest overlaps the end of src. copies the unaligned tail
+ * bytes first, then the remaining qwords, both from high to low address.
+ */
+static void copy_backward(uint8_t *dest, const uint8_t *src, uint64_t count)
+{
+	uint64_t tail = count & 7;
+	uint64_t qwords = count >> 3;
+
+	dest += count - 1;
+	src += count - 1;
+
+	__asm__ __volatile__ (
+		"std        \n\t"
+		"rep movsb  \n\t"
+		"subq $7, %%rdi \n\t"
+		"subq $7, %%rsi \n\t"
+		"movq %3, %%rcx \n\t"
+		"rep movsq  \n\t"
+		"cld        \n\t"
+		: "+D" (dest), "+S" (src), "+c" (tail)
+		: "r" (qwords)
+		: "memory");
+}
+
+/* caller must make sure dest and src do not overlap, use memmove()
+ * otherwise.
+ */
+void memcpy(void *dest, const void *src, uint64_t count)
+{
+	copy_forward((uint8_t *)dest, (const uint8_t *)src, count, simd_ops.copy);
+}
+
+void memmove(void *dest, const void *src, uint64_t count)
+{
+	uint64_t d = (uint64_t)dest;
+	uint64_t s = (uint64_t)src;
+
+	/* a forward copy is safe unless dest starts inside src */
+	if ((d > s) && (d - s < count))
+		copy_backward((uint8_t *)dest, (const uint8_t *)src, count);
+	else
+		copy_forward((uint8_t *)dest, (const uint8_t *)src, count,
+				simd_ops.copy);
+}
+
+/* the streaming variants bypass the cache for the bulk of the range, which
+ * keeps the package, multiboot info and boot params cached while megabytes
+ * of trusty image go out to memory. they end with "sfence" so the weakly
+ * ordered stores are globally visible before the caller goes on.
+ */
+void memcpy_stream(void *dest, const void *src, uint64_t count)
+{
+	if (!simd_ops.stream_copy || (count < STREAM_MIN_SIZE)) {
+		memcpy(dest, src, count);
+		return;
+	}
+
+	copy_forward((uint8_t *)dest, (const uint8_t *)src, count,
+			simd_ops.stream_copy);
+	__asm__ __volatile__ ("sfence" ::: "memory");
+}
+
+void memcpy_stream_part(void *dest, const void *src, uint64_t count,
+		uint64_t total)
+{
+	if (!simd_ops.stream_copy || (total < STREAM_MIN_SIZE)) {
+		memcpy(dest, src, count);
+		return;
+	}
+
+	copy_forward((uint8_t *)dest, (const uint8_t *)src, count,
+			simd_ops.stream_copy);
 }
 
+void memcpy_stream_end(void)
+{
+	__asm__ __volatile__ ("sfence" ::: "memory");
+}
+
+void memset_stream(void *dest, uint8_t val, uint64_t count)
+{
+	uint8_t *d = (uint8_t *)dest;
+	uint64_t done;
+
+	if ((val != 0) || !simd_ops.stream_zero || (count < STREAM_MIN_SIZE)) {
+		memset(dest, val, count);
+		return;
+	}
+
+	done = zero_bulk(d, count, simd_ops.stream_zero);
+	set_bytes(d + done, 0, count - done);
+	__asm__ __volatile__ ("sfence" ::: "memory");
+}
@@ -19,6 +19,24 @@
 #include "trusty_loader_base.h"
 
 void memcpy(void *dest, const void *src, uint64_t count);
+void memmove(void *dest, const void *src, uint64_t count);
 void memset(void *dest, uint8_t val, uint64_t count);
 
+/* same as memcpy()/memset(), but large ranges are written with
+ * non-temporal stores. use them for data that is not read back soon.
+ */
+void memcpy_stream(void *dest, const void *src, uint64_t count);
+void memset_stream(void *dest, uint8_t val, uint64_t count);
+
+/* memcpy_stream() of a range of total bytes done count bytes at a time:
+ * each piece gets non-temporal stores if the whole range would. no
+ * sfence, call memcpy_stream_end() after the last piece.
+ */
+void memcpy_stream_part(void *dest, const void *src, uint64_t count,
+		uint64_t total);
+void memcpy_stream_end(void);
+
+/* select the copy/zero kernels for the given SIMD_* level, see cpu.h */
+void util_init(uint32_t simd_level);
+
 #endif